@@ -0,0 +1,126 @@
+/*
+ * calloc_bench.c - Finds the block size from which calloc() should clear
+ *      with non-temporal stores rather than memset, to pick NT_THRESHOLD.
+ *      It includes mm.c to reach the clearing routines. Build and run with
+ *
+ *          cc -O2 -DDRIVER calloc_bench.c memlib.c -lpthread && ./a.out
+ *
+ * For every block size it times clearing the block, then reading back a
+ * hot working set the size of a typical L2 cache, which a clear through
+ * the cache partly evicts. Each figure is the median of REPEATS runs. The
+ * crossover is the smallest size from which the streaming clear wins on
+ * the two together at every larger size as well.
+ */
+#include "mm.c"
+#include <time.h>
+
+#define HOT_BYTES (256 << 10)  /* working set read after every clear */
+#define MIN_BYTES (4 << 10)
+#define MAX_BYTES (16 << 20)
+#define TOTAL_BYTES (256 << 20) /* bytes cleared per size and method */
+#define REPEATS 5              /* runs per size and method */
+
+static volatile unsigned long sink;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * run - Clear buf of size bytes with clear over and over, reading the
+ *      hot set after each clear. Stores the nanoseconds per round spent
+ *      clearing and reading in *tclear and *thot.
+ */
+static void run(void (*clear)(void *, size_t), char *buf, size_t size,
+	unsigned long *hot, double *tclear, double *thot)
+{
+	size_t rounds = MAX(TOTAL_BYTES / size, 16), i, j;
+	unsigned long sum = 0;
+	double t0, t1, c = 0, h = 0;
+	for (i = 0; i < rounds; i++) {
+		t0 = now();
+		clear(buf, size);
+		t1 = now();
+		for (j = 0; j < HOT_BYTES / sizeof(*hot); j += 8)
+			sum += hot[j];
+		c += t1 - t0;
+		h += now() - t1;
+	}
+	sink = sum;
+	*tclear = c / rounds;
+	*thot = h / rounds;
+}
+
+/*
+ * run_median - run() REPEATS times and store the clearing and reading 
+ *      times of the run whose total is the median
+ */
+static void run_median(void (*clear)(void *, size_t), char *buf, 
+	size_t size, unsigned long *hot, double *tclear, double *thot)
+{
+	double c[REPEATS], h[REPEATS], t;
+	int i, j;
+	for (i = 0; i < REPEATS; i++) {
+		run(clear, buf, size, hot, &c[i], &h[i]);
+		/* insert by total */
+		for (j = i; j > 0 && c[j-1] + h[j-1] > c[j] + h[j]; j--) {
+			t = c[j]; c[j] = c[j-1]; c[j-1] = t;
+			t = h[j]; h[j] = h[j-1]; h[j-1] = t;
+		}
+	}
+	*tclear = c[REPEATS / 2];
+	*thot = h[REPEATS / 2];
+}
+
+static void clear_memset(void *p, size_t n)
+{
+	memset(p, 0, n);
+}
+
+int main(void)
+{
+	unsigned long *hot;
+	char *buf;
+	double mc, mh, sc, sh;
+	size_t size, crossover = 0;
+	mem_init();
+	mm_init();
+	if (zero_stream == NULL) {
+		printf("no streaming clear on this CPU\n");
+		return 0;
+	}
+	buf = mmap(NULL, MAX_BYTES, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	hot = mmap(NULL, HOT_BYTES, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED || hot == MAP_FAILED)
+		return 1;
+	memset(buf, 1, MAX_BYTES);
+	memset(hot, 1, HOT_BYTES);
+	printf("%10s %12s %12s %12s %12s\n", "bytes",
+		"memset ns", "+hot ns", "stream ns", "+hot ns");
+	for (size = MIN_BYTES; size <= MAX_BYTES; size <<= 1) {
+		run_median(clear_memset, buf, size, hot, &mc, &mh);
+		run_median(zero_stream, buf, size, hot, &sc, &sh);
+		printf("%10zu %12.0f %12.0f %12.0f %12.0f\n", size, mc, mh, sc, sh);
+		/* a size where memset wins moves the crossover past it */
+		if (sc + sh >= mc + mh)
+			crossover = 0;
+		else if (crossover == 0)
+			crossover = size;
+	}
+	if (crossover != 0)
+		printf("streaming wins from %zu bytes, NT_THRESHOLD is %d\n",
+			crossover, NT_THRESHOLD);
+	else
+		printf("streaming does not keep winning up to %d bytes, "
+			"NT_THRESHOLD is %d\n", MAX_BYTES, NT_THRESHOLD);
+	if (NT_THRESHOLD >= HUGE_THRESHOLD)
+		printf("calloc() maps blocks from HUGE_THRESHOLD (%d) bytes fresh, "
+			"so it only streams with HUGE_THRESHOLD raised or the huge "
+			"table full\n", HUGE_THRESHOLD);
+	return 0;
+}
@@ -2,6 +2,8 @@
  * memlib.c - a module that simulates the memory system.	Needed because it 
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
+ *						Outside the driver the same interface hands out real memory, 
+ *						from the process break or from mmap, see mem_init_provider().
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,78 +15,414 @@
 #include <fcntl.h>
 
 #include "memlib.h"
+#ifdef __has_include
+#if __has_include("config.h")
 #include "config.h"
+#endif
+#endif
 
-/* private variables */
-static char *heap;
-static char *mem_brk;
-static char *mem_max_addr;
+/* the driver's config.h sets the size of a simulated region */
+#ifndef MAX_HEAP
+#define MAX_HEAP (100*(1<<20))
+#endif
+
+/* The provider mem_init() uses: the simulator for the driver, else real 
+   memory with no ceiling but the address space a region reserves */
+#ifndef MEM_PROVIDER
+#ifdef DRIVER
+#define MEM_PROVIDER MEM_SIMULATED
+#else
+#define MEM_PROVIDER MEM_MMAP
+#endif
+#endif
 
 /* 
- * mem_init - initialize the memory system model
+ * Address space a real region reserves. The allocator keeps 32-bit offsets 
+ * into a region, so it never needs more than 4GB of one; a region only 
+ * holds the pages it has committed.
  */
-void mem_init(void){
+#ifndef MEM_RESERVE
+#define MEM_RESERVE (1UL << 32)
+#endif
+
+/* 
+ * A MEM_MMAP region reserves its range PROT_NONE, which costs neither 
+ * memory nor commit charge, and makes it writable at least this many 
+ * bytes at a time as the break advances. 
+ */
+#ifndef MEM_COMMIT_STEP
+#define MEM_COMMIT_STEP (1<<16)
+#endif
+
+/* 
+ * The default region, which mem_sbrk() and friends work on, is regions[0]. 
+ * mem_region_new() reserves more of them, up to MAX_REGIONS. Creating 
+ * regions is not thread-safe, the caller serializes it.
+ */
+#define MAX_REGIONS 64
+
+#define PAGE_UP(p) ((char *)(((size_t)(p) + mem_pagesize() - 1) \
+	& ~(mem_pagesize() - 1)))
+
+/* 
+ * A provider reserves a region and makes its pages usable below the 
+ * break. Everything a provider hands out reads as zero. 
+ */
+struct mem_ops {
+	/* reserve r, at addr if the provider takes a hint */
+	int (*map)(mem_region_t *r, void *addr);
+	/* make memory up to end usable; r->mapped is what already is */
+	int (*commit)(mem_region_t *r, char *end);
+	/* hand the whole pages from start to end back, leaving them zero */
+	void (*decommit)(mem_region_t *r, char *start, char *end);
+	/* release r */
+	void (*unmap)(mem_region_t *r);
+};
+
+/*these functions make up the providers*/
+static int sim_map(mem_region_t *r, void *addr);
+static int mmap_map(mem_region_t *r, void *addr);
+static int mmap_commit(mem_region_t *r, char *end);
+static void mmap_decommit(mem_region_t *r, char *start, char *end);
+static int map_commit(mem_region_t *r, char *end);
+static void map_decommit(mem_region_t *r, char *start, char *end);
+static void map_unmap(mem_region_t *r);
+static int sbrk_map(mem_region_t *r, void *addr);
+static int sbrk_commit(mem_region_t *r, char *end);
+static void sbrk_decommit(mem_region_t *r, char *start, char *end);
+static void sbrk_unmap(mem_region_t *r);
+
+static const mem_ops_t sim_ops = 
+	{ sim_map, map_commit, map_decommit, map_unmap };
+static const mem_ops_t mmap_ops = 
+	{ mmap_map, mmap_commit, mmap_decommit, map_unmap };
+static const mem_ops_t sbrk_ops = 
+	{ sbrk_map, sbrk_commit, sbrk_decommit, sbrk_unmap };
+
+/* private variables */
+static mem_region_t regions[MAX_REGIONS];
+static int num_regions;
+static const mem_ops_t *region_ops;	/* provider of regions after the first */
+
+/*
+ * sim_map - reserve MAX_HEAP bytes for r at the suggested start addr
+ */
+static int sim_map(mem_region_t *r, void *addr){
 	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
+	r->heap = mmap(addr,			/* suggested start*/
 			MAX_HEAP,				/* length */
 			PROT_WRITE,				/* permissions */
 			MAP_PRIVATE,			/* private or shared? */
 			dev_zero,				/* fd */
 			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
-	mem_brk = heap;					/* heap is empty initially */
+	close(dev_zero);
+	if (r->heap == MAP_FAILED)
+		return -1;
+	r->max_addr = r->heap + MAX_HEAP;
+	return 0;
+}
+
+/*
+ * mmap_map - reserve MEM_RESERVE bytes of address space for r, none of it 
+ *		accessible yet, wherever the kernel puts it. Not MAP_NORESERVE, 
+ *		which would keep the pages mmap_commit() makes writable out of the 
+ *		commit charge.
+ */
+static int mmap_map(mem_region_t *r, void *addr){
+	(void)addr;
+	r->heap = mmap(NULL, MEM_RESERVE, PROT_NONE, 
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (r->heap == MAP_FAILED)
+		return -1;
+	r->max_addr = r->heap + MEM_RESERVE;
+	return 0;
+}
+
+/*
+ * map_commit - a mapped region is usable throughout, just move the mark
+ */
+static int map_commit(mem_region_t *r, char *end){
+	r->mapped = PAGE_UP(end);
+	return 0;
+}
+
+/*
+ * map_decommit - drop the pages, the next touch faults in zero ones
+ */
+static void map_decommit(mem_region_t *r, char *start, char *end){
+	madvise(start, end - start, MADV_DONTNEED);
+	r->mapped = start;
+}
+
+/*
+ * mmap_commit - make the reservation writable up to end, in steps of at 
+ *		least MEM_COMMIT_STEP. Fails if the system will not commit more.
+ */
+static int mmap_commit(mem_region_t *r, char *end){
+	char *top = PAGE_UP(end);
+	if (top - r->mapped < MEM_COMMIT_STEP)
+		top = r->max_addr - r->mapped < MEM_COMMIT_STEP 
+			? r->max_addr : r->mapped + MEM_COMMIT_STEP;
+	if (mprotect(r->mapped, top - r->mapped, PROT_READ | PROT_WRITE) < 0)
+		return -1;
+	r->mapped = top;
+	return 0;
+}
+
+/*
+ * mmap_decommit - return the committed pages from start on to the 
+ *		reservation. Mapping over them drops their contents and their 
+ *		commit charge in one go.
+ */
+static void mmap_decommit(mem_region_t *r, char *start, char *end){
+	if (mmap(start, r->mapped - start, PROT_NONE, 
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) 
+		== MAP_FAILED) {
+		/* keep them committed, but still hand the pages back */
+		madvise(start, end - start, MADV_DONTNEED);
+		return;
+	}
+	r->mapped = start;
+}
+
+/*
+ * map_unmap - unmap the whole reservation
+ */
+static void map_unmap(mem_region_t *r){
+	munmap(r->heap, r->max_addr - r->heap);
+}
+
+/*
+ * sbrk_map - start r at the process break, rounded up to a page. The 
+ *		hint addr does not apply.
+ */
+static int sbrk_map(mem_region_t *r, void *addr){
+	char *brk = sbrk(0);
+	(void)addr;
+	if (brk == (void *)-1 
+		|| (PAGE_UP(brk) != brk && sbrk(PAGE_UP(brk) - brk) == (void *)-1))
+		return -1;
+	r->heap = PAGE_UP(brk);
+	r->max_addr = r->heap + MEM_RESERVE;
+	return 0;
+}
+
+/*
+ * sbrk_commit - move the process break up to end. Fails if something else 
+ *		moved the break since, as the region would no longer be contiguous.
+ */
+static int sbrk_commit(mem_region_t *r, char *end){
+	/* whole pages, so that no one else's memory shares the last one */
+	char *brk = sbrk(PAGE_UP(end) - r->mapped);
+	if (brk == (void *)-1)
+		return -1;
+	if (brk != r->mapped) {
+		sbrk(-(PAGE_UP(end) - r->mapped));
+		return -1;
+	}
+	r->mapped = PAGE_UP(end);
+	return 0;
+}
+
+/*
+ * sbrk_decommit - lower the process break to start if the region still 
+ *		ends at it, else just drop the pages
+ */
+static void sbrk_decommit(mem_region_t *r, char *start, char *end){
+	if (sbrk(0) == r->mapped && brk(start) == 0)
+		r->mapped = start;
+	else
+		madvise(start, end - start, MADV_DONTNEED);
+}
+
+/*
+ * sbrk_unmap - give back as much of r as the break allows
+ */
+static void sbrk_unmap(mem_region_t *r){
+	sbrk_decommit(r, r->heap, r->mapped);
+}
+
+/*
+ * mem_region_map - reserve region r from ops, empty
+ */
+static int mem_region_map(mem_region_t *r, const mem_ops_t *ops, void *addr){
+	if (ops->map(r, addr) < 0)
+		return -1;
+	r->brk = r->heap;				/* heap is empty initially */
+	r->mapped = r->heap;
+	r->ops = ops;
+	return 0;
+}
+
+/* 
+ * mem_init - initialize the memory system model
+ */
+void mem_init(void){
+	mem_init_provider(MEM_PROVIDER);
+}
+
+/*
+ * mem_init_provider - initialize the memory system with the default 
+ *		region from provider, one of enum mem_provider. Further regions 
+ *		come from the same provider, except that there is only one process 
+ *		break, so with MEM_SBRK they come from MEM_MMAP. The default region 
+ *		stops growing once anything else moves the break, so MEM_SBRK is for 
+ *		when this allocator replaces libc's. Returns 0 on success, -1 if the 
+ *		default region could not be reserved.
+ */
+int mem_init_provider(int provider){
+	const mem_ops_t *ops;
+	switch (provider) {
+	case MEM_SIMULATED:
+		ops = region_ops = &sim_ops;
+		break;
+	case MEM_SBRK:
+		ops = &sbrk_ops;
+		region_ops = &mmap_ops;
+		break;
+	case MEM_MMAP:
+		ops = region_ops = &mmap_ops;
+		break;
+	default:
+		return -1;
+	}
+	/* the regions of an earlier init are given back, not leaked */
+	mem_deinit();
+	if (mem_region_map(&regions[0], ops, (void *)0x800000000) < 0)
+		return -1;
+	num_regions = 1;
+	return 0;
 }
 
 /* 
- * mem_deinit - free the storage used by the memory system model
+ * mem_deinit - free the storage used by the memory system model. The 
+ *		regions read as unmapped afterwards, with a NULL heap.
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	int i;
+	for (i = 0; i < num_regions; i++)
+		regions[i].ops->unmap(&regions[i]);
+	memset(regions, 0, num_regions * sizeof(regions[0]));
+	num_regions = 0;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the brk pointers to make empty heaps, 
+ *		handing their pages back to the system
  */
 void mem_reset_brk(){
-	mem_brk = heap;
+	int i;
+	for (i = 0; i < num_regions; i++) {
+		if (regions[i].brk > regions[i].heap)
+			regions[i].ops->decommit(&regions[i], regions[i].heap, 
+				regions[i].brk);
+		regions[i].brk = regions[i].heap;
+	}
 }
 
 /* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ * mem_sbrk - simple model of the sbrk function, on the default region
  */
 void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
+	return mem_region_sbrk(&regions[0], incr);
+}
+
+/*
+ * mem_region_default - return the region mem_sbrk() works on
+ */
+mem_region_t *mem_region_default(){
+	return &regions[0];
+}
+
+/*
+ * mem_region_new - reserve another region, or return NULL if there is no 
+ *		room for one
+ */
+mem_region_t *mem_region_new(){
+	if (num_regions == MAX_REGIONS 
+		|| mem_region_map(&regions[num_regions], region_ops, NULL) < 0)
+		return NULL;
+	return &regions[num_regions++];
+}
+
+/* 
+ * mem_region_sbrk - Extends region r by incr bytes and returns the start 
+ *		address of the new area. A negative incr shrinks the region and 
+ *		hands the whole pages above the new break back to the system. 
+ *		Memory above the break always reads as zero.
+ */
+void *mem_region_sbrk(mem_region_t *r, int incr) {
+	char *old_brk = r->brk;
+	char *start;
 
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+	if ((incr < 0 && (r->brk + incr) < r->heap) 
+		|| ((r->brk + incr) > r->max_addr) 
+		|| ((r->brk + incr) > r->mapped && r->ops->commit(r, r->brk + incr) < 0)) {
 		errno = ENOMEM;
+#ifdef DRIVER
+		/* outside the driver a failed commit is routine, and stderr 
+		   belongs to the program */
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+#endif
 		return (void *)-1;
 	}
-	mem_brk += incr;
+	r->brk += incr;
+	if (incr < 0) {
+		start = PAGE_UP(r->brk);
+		if (start < old_brk)
+			r->ops->decommit(r, start, old_brk);
+		else
+			start = old_brk;
+		/* the rest of the page the break now falls in */
+		memset(r->brk, 0, start - r->brk);
+	}
 	return (void *)old_brk;
 }
 
+/*
+ * mem_region_lo - return address of the first byte of region r
+ */
+void *mem_region_lo(mem_region_t *r){
+	return (void *)r->heap;
+}
+
+/* 
+ * mem_region_hi - return address of the last byte in use in region r
+ */
+void *mem_region_hi(mem_region_t *r){
+	return (void *)(r->brk - 1);
+}
+
+/*
+ * mem_region_size - returns the bytes in use in region r
+ */
+size_t mem_region_size(mem_region_t *r){
+	return (size_t)(r->brk - r->heap);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo(){
-	return (void *)heap;
+	return mem_region_lo(&regions[0]);
 }
 
 /* 
  * mem_heap_hi - return address of last heap byte
  */
 void *mem_heap_hi(){
-	return (void *)(mem_brk - 1);
+	return mem_region_hi(&regions[0]);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, summed over all regions
  */
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	size_t size = 0;
+	int i;
+	for (i = 0; i < num_regions; i++)
+		size += mem_region_size(&regions[i]);
+	return size;
 }
 
 /*
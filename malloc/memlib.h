@@ -1,11 +1,37 @@
 #include <unistd.h>
 
-void mem_init(void);               
+/* Where regions get their memory from, see memlib.c */
+enum mem_provider {
+	MEM_SIMULATED,	/* a fixed MAX_HEAP mapping per region, for the driver */
+	MEM_SBRK,		/* the process break, then mmap for further regions */
+	MEM_MMAP		/* a large PROT_NONE reservation per region, committed 
+					   as the break advances */
+};
+
+typedef struct mem_ops mem_ops_t;
+
+/* A heap: a reserved range of its own and a break inside it */
+typedef struct {
+	char *heap;         /* first byte of the region */
+	char *brk;          /* current break */
+	char *max_addr;     /* end of the reserved range */
+	char *mapped;       /* end of the memory the provider handed out */
+	const mem_ops_t *ops; /* provider the region came from */
+} mem_region_t;
+
+void mem_init(void);
+int mem_init_provider(int provider);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
-void mem_reset_brk(void); 
+void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
+mem_region_t *mem_region_default(void);
+mem_region_t *mem_region_new(void);
+void *mem_region_sbrk(mem_region_t *r, int incr);
+void *mem_region_lo(mem_region_t *r);
+void *mem_region_hi(mem_region_t *r);
+size_t mem_region_size(mem_region_t *r);
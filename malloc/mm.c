@@ -1,15 +1,34 @@
 /* 
- * Simple allocator based on explicit free lists, first fit placement, 
- * and boundary tag coalescing.
+ * Simple allocator based on segregated explicit free lists, first fit 
+ * placement, and boundary tag coalescing.
  * Blocks must be aligned to doubleword (8 byte) boundaries.
- * Minimum block size is 16 bytes. 
+ * Allocated blocks carry only a header, whose prev-allocated bit stands in 
+ * for the footer of the block before; free blocks have a footer as well.
+ * Minimum block size is 16 bytes. Requests of up to SLAB_MAX bytes are 
+ * served header-less from page-sized slabs instead, and requests of at 
+ * least HUGE_THRESHOLD bytes get an mmap of their own outside the heap.
+ * Threads allocate from separate arenas, each a heap of its own.
  */
 
+#define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GLIBC__) && !defined(NO_RSEQ)
+#if __GLIBC_PREREQ(2, 35)
+#define RSEQ
+#include <sys/rseq.h>
+#endif
+#endif
 
 #include "mm.h"
 #include "memlib.h"
@@ -29,25 +48,64 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define memalign mm_memalign
+#define valloc mm_valloc
 #endif /* def DRIVER */
 
 /*
- * If NEXT_FIT defined use next fit search, else use first fit search 
+ * If NEXT_FIT defined the default placement policy is next fit, else first 
+ * fit. Either can be changed at run time with mm_set_policy().
  */
 #define NEXT_FITx
 
+/*
+ * If TLSF defined use the two-level segregated fit engine, which finds a
+ * free bin in constant time through a pair of bitmaps, else use first fit
+ * search over power-of-two segregated lists
+ */
+#define TLSFx
+
+/*
+ * If TLSF_SCAN defined, a TLSF lookup that finds no bin at or above the 
+ * rounded size walks asize's own bin for a fit before the heap grows. That 
+ * grows the heap less, but gives up the constant time bound.
+ */
+#define TLSF_SCANx
+
 /* begin mallocmacros */
 /* Basic constants and macros */
 #define WSIZE       4       /* Word and header/footer size (bytes) */
 #define DSIZE       8       /* Doubleword size (bytes) */
 /*The small chunksize allows us to allocate only the required amount of bytes 
 and thus saves us a lot on unused heap space at the end of the trace*/
-#define CHUNKSIZE (1<<8) /* Extend heap by this amount (bytes) */ 
+#define CHUNKSIZE (1<<8) /* Extend heap by at least this amount (bytes) */ 
+/*
+ * While the heap keeps growing each extension doubles the arena's growth 
+ * step, up to CHUNK_MAX bytes, so that a burst takes a few large sbrk 
+ * calls rather than many small ones. Every CHUNK_DECAY requests served 
+ * without growing halve it again, down to CHUNKSIZE. The cap defaults to 
+ * TRIM_PAD, the free top that trimming leaves anyway.
+ */
+#ifndef CHUNK_MAX
+#define CHUNK_MAX TRIM_PAD
+#endif
+#define CHUNK_DECAY 256
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
+/* Pack a size and allocated bits into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
+#define PREV_ALLOC  0x2     /* header bit: the previous block is allocated */
+/* Header and footer bit of a free block whose payload is known to be zero 
+   past the first 4 words, which hold its list or tree links, up to its 
+   footer. Memory above the break reads as zero, so blocks grown from it 
+   start out zeroed; so do blocks mm_trim() releases the pages of. A 
+   block loses the bit when it is merged with another, and calloc() 
+   only clears the words the bit leaves out. */
+#define ZEROED      0x4
 
 /* Read and write a word at address p */
 #define GET(p)       (*(unsigned int *)(p))  
@@ -56,292 +114,2825 @@ and thus saves us a lot on unused heap space at the end of the trace*/
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)               
 #define GET_ALLOC(p) (GET(p) & 0x1)                
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+/* Update the prev-allocated bit of the header at p */
+#define SET_PREV_ALLOC(p)   PUT(p, GET(p) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Given block ptr bp, compute address of its header and footer.
+   Only free blocks have a footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)      
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
 /* Given block ptr bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
+/* PREV_BLKP is only valid when the previous block is free */
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 /*used to convert between pointers and offsets for the explicit list*/
-#define GET_ADDR_INDEX(bp) (unsigned)((char *)bp - (char *)heap_listp)
-#define GET_ADDR(index) (((char *)heap_listp) + index)
-/*This macro aligns a size by DSIZE and 
-adds an extra 8 bytes for the header and the footer*/
-#define ALIGN(size) ((size + 15) & ~0x7)
+#define GET_ADDR_INDEX(bp) (unsigned)((char *)bp - (char *)arena->heap_listp)
+#define GET_ADDR(index) (((char *)arena->heap_listp) + index)
+/*This macro adds an extra 4 bytes for the header 
+and aligns the result by DSIZE*/
+#define ALIGN(size) ((size + WSIZE + 7) & ~0x7)
+
+#ifdef TLSF
+/*
+ * TLSF bins: the first level splits sizes by power of two, the second 
+ * level splits each power of two into SL_COUNT equal ranges. Sizes below 
+ * 2^FL_SHIFT all live in first level 0, binned linearly by DSIZE.
+ * Bit sl of sl_bitmap[fl] is set whenever bin (fl, sl) is non-empty and 
+ * bit fl of fl_bitmap is set whenever sl_bitmap[fl] is non-zero.
+ */
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 3)
+#define FL_COUNT (32 - FL_SHIFT + 1)
+#define NUM_CLASSES (FL_COUNT * SL_COUNT)
+#define CLASS_MAPPED(cls) \
+	((arena->sl_bitmap[(cls) / SL_COUNT] >> ((cls) % SL_COUNT)) & 1)
+#else
+/*
+ * Free blocks are kept in segregated lists, one per power-of-two size 
+ * class. Class 0 holds blocks of 16..31 bytes, class k holds blocks of 
+ * [2^(k+4), 2^(k+5)) bytes and the last class holds everything larger.
+ * Bit k of classmap is set whenever list k is non-empty.
+ */
+#define NUM_CLASSES 20
+#define MIN_CLASS_SHIFT 4
+#define CLASS_MAPPED(cls) ((arena->classmap >> (cls)) & 1)
+#endif
+
+/*
+ * Free blocks of at least TREE_THRESHOLD bytes bypass the lists and are 
+ * kept in a red-black tree ordered by (size, address), which gives 
+ * O(log n) best fit for large requests. The node lives in the payload: 
+ * left, right and parent offsets followed by the colour word, so the 
+ * threshold must leave room for 4 words plus the header and footer.
+ * The TLSF engine keeps large blocks in its own bins instead so that its 
+ * bound stays constant.
+ */
+#ifndef TREE_THRESHOLD
+#define TREE_THRESHOLD (1<<10)
+#endif
+#ifdef TLSF
+#define IS_TREE_SIZE(size) 0
+#else
+#define IS_TREE_SIZE(size) ((size) >= TREE_THRESHOLD)
+#endif
+
+/*
+ * Requests of at most SLAB_MAX bytes are served from slabs: page-aligned 
+ * SLAB_BYTES pages, each holding one allocated heap block's payload, that 
+ * are carved into equal slots of a multiple of DSIZE with no per-object 
+ * header. The slab_t at the start of the page tracks free slots in a 
+ * bitmap. A bit per heap page in slab_pages tells free() and realloc() 
+ * whether a pointer lies inside a slab. SLAB_MAX of 0 disables slabs.
+ */
+#ifndef SLAB_MAX
+#define SLAB_MAX 128
+#endif
+#define SLAB_SHIFT 12
+#define SLAB_BYTES (1 << SLAB_SHIFT)
+/* The next block's header ends the page, so that slabs grown one after 
+   the other sit on consecutive pages */
+#define SLAB_PAYLOAD (SLAB_BYTES - WSIZE)
+#define NUM_SLAB_CLASSES (SLAB_MAX / DSIZE)
+#define SLAB_CLASS(size) (((size) + DSIZE - 1) / DSIZE - 1)
+#define SLAB_OF(p) ((slab_t *)((size_t)(p) & ~(size_t)(SLAB_BYTES - 1)))
+/* Index of the page holding p, counted from the first page of arena a */
+#define SLAB_PAGE(a, p) \
+	(((size_t)(p) >> SLAB_SHIFT) - ((size_t)(a)->heap_listp >> SLAB_SHIFT))
+#define IS_SLAB_PTR(a, p) (SLAB_PAGE(a, p) < (1UL << (32 - SLAB_SHIFT)) \
+	&& (((a)->slab_pages[SLAB_PAGE(a, p) / 32] >> (SLAB_PAGE(a, p) % 32)) & 1))
+
+/*
+ * Freed blocks from FAST_MIN to FAST_MAX bytes are not coalesced right 
+ * away but pushed on an exact-size LIFO fast bin, still marked allocated 
+ * so that coalesce() leaves them alone, and linked through their first 
+ * payload word. malloc() pops them in O(1). The bins are merged back into 
+ * the free lists once they hold more than FAST_BUDGET blocks or a request 
+ * finds no fit. Smaller requests are slab slots, so the bins start at the 
+ * smallest block a request above SLAB_MAX gets.
+ */
+#define FAST_MIN     MAX(ALIGN(SLAB_MAX + 1), 2*DSIZE) /* smallest size */
+#define NUM_FAST     9                    /* one bin per size from FAST_MIN */
+#define FAST_MAX     (FAST_MIN + (NUM_FAST - 1)*DSIZE) /* largest size */
+#define FAST_INDEX(size) (((size) - FAST_MIN)/DSIZE)
+#define IS_FAST_SIZE(size) ((size) >= FAST_MIN && (size) <= FAST_MAX)
+#define FAST_BUDGET  512
+
+/*
+ * Requests of at least HUGE_THRESHOLD bytes are mapped on their own with 
+ * mmap, so they never grow the heap and are returned to the system as 
+ * soon as they are freed. The payload starts at the mapping, which is 
+ * recorded in huge_table; any pointer outside the heap is looked up 
+ * there. When the table is full huge requests fall back to the heap.
+ */
+#ifndef HUGE_THRESHOLD
+#define HUGE_THRESHOLD (1<<18)
+#endif
+#define HUGE_SLOTS 64
+/* Does p lie inside the region of arena a. Only up to what the region 
+   has mapped, as a region at the process break does not own the range 
+   above it, and every block of the arena lies below its break. */
+#define IN_ARENA(a, p) ((size_t)((char *)(p) - (a)->region->heap) \
+	< (size_t)((a)->region->mapped - (a)->region->heap))
+
+/*
+ * Whenever free() leaves a free block of at least TRIM_THRESHOLD bytes at 
+ * the top of the heap, the heap is shrunk so that only TRIM_PAD bytes of 
+ * it stay free. mm_trim() does the same on demand.
+ */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (1<<17)
+#endif
+
+/*
+ * calloc() clears blocks of at least NT_THRESHOLD bytes with non-temporal 
+ * stores, which go around the cache instead of evicting the working set 
+ * for memory the caller may not touch for a while. On x86-64 mm_init() 
+ * picks AVX2 stores when the CPU has them and SSE2 stores otherwise; 
+ * elsewhere every block is cleared with memset. calloc_bench.c measures 
+ * from what size, if any, streaming keeps paying off; the default sits 
+ * well past the L2 cache size, where it was about even with memset. 
+ */
+#ifndef NT_THRESHOLD
+/* above HUGE_THRESHOLD by default, so the streaming clear only runs for 
+   heap blocks past it: with HUGE_THRESHOLD raised or huge_table full */
+#define NT_THRESHOLD (1<<23)
+#endif
+#ifndef TRIM_PAD
+#define TRIM_PAD (1<<16)
+#endif
+/* blocks a trim walks before it lets others at the arena */
+#ifndef TRIM_BATCH
+#define TRIM_BATCH 256
+#endif
+
+/*
+ * mm_background() starts a maintenance thread that every period, or as 
+ * soon as free() finds work piling up, empties the transfer caches, 
+ * remote stacks and fast bins of every arena and trims it as mm_trim() 
+ * would, keeping TRIM_PAD bytes. While it runs free() leaves that work 
+ * to it: a fast bin over FAST_BUDGET or a free top over TRIM_THRESHOLD 
+ * only wakes the thread.
+ */
+
+/*
+ * The heap is split into arenas. Each has a memlib region of its own to 
+ * grow in, its own free lists, tree, bins and slabs, and its own lock. A 
+ * thread is bound to an arena round-robin when it first calls malloc or 
+ * free, and a block always goes back to the arena whose region holds it. 
+ * Arenas are created as threads need them, up to NUM_ARENAS but no more 
+ * than there are CPUs online. A thread that frees a block of some other 
+ * arena does not take that arena's lock: it pushes the block on the 
+ * arena's remote stack with a single compare-and-swap, and whichever 
+ * thread next allocates from the arena under its lock drains the whole 
+ * stack at once. The heap code below works on the arena 
+ * whose lock the calling thread holds. When more than one lock is held 
+ * they are taken in the order bg_lock, arenas_lock, a transfer cache bin 
+ * lock, arena locks by index, huge_lock.
+ */
+#ifndef NUM_ARENAS
+#define NUM_ARENAS 64
+#endif
+
+/*
+ * In front of the arenas every thread keeps a cache of recently freed 
+ * blocks, one LIFO bin per slab class and per heap block size up to 
+ * TC_MAX, linked through the first payload word. Cached blocks still look 
+ * allocated to their arena. A miss refills its bin with TC_BATCH blocks 
+ * and an overfull bin flushes TC_BATCH of them, a whole batch under a 
+ * single acquisition of a lock, so most malloc and free calls never take 
+ * a lock.
+ */
+#define TC_MAX      (1<<10)     /* largest heap block size cached */
+#define TC_HEAP_MIN MAX(ALIGN(SLAB_MAX + 1), 2*DSIZE) /* smallest one */
+#define TC_BINS     (NUM_SLAB_CLASSES + (TC_MAX - TC_HEAP_MIN)/DSIZE + 1)
+#define TC_LIMIT    32          /* blocks a bin holds before it flushes */
+#define TC_BATCH    8           /* blocks moved per refill or flush */
+
+/*
+ * Between the front-end caches and the heap every arena keeps a transfer 
+ * cache per bin, a stack of up to CENTRAL_MAX blocks with a lock of its 
+ * own. Refills and flushes move their batches through it, so threads 
+ * working on different sizes do not wait for each other, and only the 
+ * batches it cannot serve or hold reach the heap under the arena lock. 
+ * The arena lock still covers the free lists, coalescing across them 
+ * and growing the heap, which touch blocks of every size. A bin lock may 
+ * be held while taking the arena lock, never the other way around.
+ */
+#define CENTRAL_MAX (2*TC_LIMIT)
+
+typedef struct arena arena_t;
+
+typedef struct {
+	pthread_mutex_t lock;       /* guards this bin only */
+	unsigned count;
+	void *slot[CENTRAL_MAX];
+} central_t;
+
+typedef struct tcache {
+	unsigned generation;        /* heap the cached blocks came from */
+	arena_t *arena;             /* arena this thread allocates from */
+	unsigned short count[TC_BINS];
+	void *head[TC_BINS];
+	struct tcache *next, *prev; /* caches of all bound threads */
+} tcache_t;
+
+/*
+ * Where glibc registers restartable sequences (rseq) for its threads, on 
+ * x86-64 with glibc 2.35 or later unless NO_RSEQ is defined, the front 
+ * end is a cache per CPU instead: the same bins as a thread cache, each 
+ * an array of up to TC_LIMIT block pointers. A push or pop reads the CPU 
+ * number and commits with a single store inside an rseq critical 
+ * section, which the kernel restarts if the thread is preempted, 
+ * migrated or signalled before the commit, so it takes no lock and no 
+ * atomic instruction. Cached memory is then bounded by the number of 
+ * CPUs rather than of threads. A CPU cache holds blocks of any arena; 
+ * flushing sends each to its own. Threads rseq is not registered for 
+ * fall back to their thread cache.
+ */
+typedef struct {
+	unsigned count[TC_BINS];
+	void *slot[TC_BINS][TC_LIMIT];
+} cpucache_t;
+
+typedef struct {
+	char *addr;             /* start of the mapping and of the payload */
+	size_t len;             /* length of the mapping */
+} huge_t;
+
+typedef struct {
+	unsigned next;          /* offset of the next slab with free slots */
+	unsigned prev;          /* offset of the previous one */
+	unsigned short objsize; /* slot size in bytes */
+	unsigned short nfree;   /* free slots left */
+	unsigned short nslots;  /* slots in this slab */
+	unsigned short first;   /* page offset of slot 0 */
+	unsigned freemap[SLAB_BYTES / DSIZE / 32]; /* bit set = slot free */
+} slab_t;
+
+struct arena {
+	pthread_mutex_t lock;   /* guards the rest of the arena */
+	mem_region_t *region;   /* heap region the arena grows in */
+	char *heap_listp;       /* Pointer to first block */
+	unsigned freelists[NUM_CLASSES]; /* heads of the segregated lists */
+#ifdef TLSF
+	unsigned fl_bitmap;             /* non-empty first levels */
+	unsigned sl_bitmap[FL_COUNT];   /* non-empty bins per first level */
+#else
+	unsigned classmap;      /* non-empty classes */
+#endif
+	unsigned tree_root;     /* root of the large block tree */
+	unsigned rovers[NUM_CLASSES]; /* next fit position in each list */
+	unsigned fastbins[NUM_FAST]; /* heads of the fast bins */
+	unsigned fast_count;    /* blocks held in all fast bins */
+	/* per slab class, offset of the first slab that has free slots */
+	unsigned slab_partial[NUM_SLAB_CLASSES + 1];
+	unsigned slab_pages[(1UL << (32 - SLAB_SHIFT)) / 32]; /* slab pages */
+	void *remote;           /* blocks other threads freed, not locked */
+	size_t chunk;           /* current growth step */
+	unsigned stable;        /* fits found since the step last changed */
+	char *trim_next;        /* free block a paused trim resumes at */
+	central_t central[TC_BINS]; /* transfer caches, locked per bin */
+};
+
+#define RB_BLACK 0
+#define RB_RED   1
+/* Read and write the tree links of the free block at offset n */
+#define T_LEFT(n)           GET(GET_ADDR(n))
+#define T_RIGHT(n)          GET(GET_ADDR(n) + WSIZE)
+#define T_PARENT(n)         GET(GET_ADDR(n) + 2*WSIZE)
+#define T_COLOR(n)          GET(GET_ADDR(n) + 3*WSIZE)
+#define T_SET_LEFT(n, v)    PUT(GET_ADDR(n), v)
+#define T_SET_RIGHT(n, v)   PUT(GET_ADDR(n) + WSIZE, v)
+#define T_SET_PARENT(n, v)  PUT(GET_ADDR(n) + 2*WSIZE, v)
+#define T_SET_COLOR(n, v)   PUT(GET_ADDR(n) + 3*WSIZE, v)
+#define T_SIZE(n)           GET_SIZE(HDRP(GET_ADDR(n)))
+#define T_IS_RED(n)         ((n) != 0 && T_COLOR(n) == RB_RED)
 
 /* Global variables */
-static char *heap_listp = 0;  /* Pointer to first block */  
-unsigned freelist;
+static arena_t arenas[NUM_ARENAS];
+static int arena_count;       /* arenas created so far */
+static int arena_limit;       /* arenas to create at most */
+static unsigned next_arena;   /* where round-robin binding goes next */
+/* guards creating arenas and binding threads to them */
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread arena_t *arena; /* arena whose lock this thread holds */
+#ifdef NEXT_FIT
+static int policy = MM_NEXT_FIT;   /* placement policy for the lists */
+#else
+static int policy = MM_FIRST_FIT;
+#endif
+static unsigned good_fit_candidates = 8; /* candidates MM_GOOD_FIT weighs */
+static huge_t huge_table[HUGE_SLOTS]; /* live huge mappings */
+static int huge_count;        /* entries used in huge_table */
+static pthread_mutex_t huge_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned heap_generation; /* bumped by mm_init to void old caches */
+static __thread tcache_t tcache; /* this thread's cache */
+static pthread_key_t tcache_key; /* flushes the cache on thread exit */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static tcache_t *tcaches; /* caches of bound threads, under arenas_lock */
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+/* guards starting and stopping the maintenance thread */
+static pthread_mutex_t bg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bg_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t bg_thread;
+static int bg_running;        /* read by free() without bg_lock */
+static int bg_stop;           /* asks the thread to exit */
+static int bg_pressure;       /* free() deferred work to the thread */
+static unsigned bg_period;    /* milliseconds between passes */
+/* streaming clear for the CPU, set by mm_init */
+static void (*zero_stream)(void *p, size_t n);
+#ifdef RSEQ
+static cpucache_t *cpucaches; /* one per configured CPU, or NULL */
+static long num_cpucaches;
+#endif
 
 /* Function prototypes for internal helper routines */
 /*used to extend the heap*/
 inline static void *extend_heap(size_t words);
+/*grows the heap by need bytes or the growth step, whichever is more*/
+inline static void *grow_heap(size_t need);
 /*makes a block allocated and puts the remainder of the block back*/
 inline static void place(void *bp, size_t asize);
 /*finds a block that has atleast asize bytes after being aligned*/
 inline static void *find_fit(size_t asize);
+/*these functions do the work of the public entry points in the arena*/
+static void *heap_malloc(size_t size);
+static void heap_free(void *bp);
+static void *heap_realloc(void *ptr, size_t size);
+static void *move_block(void *ptr, size_t oldsize, size_t size);
+static void *heap_calloc(size_t size, size_t *clear);
+static size_t heap_malloc_batch(size_t size, size_t n, void **out);
+static void heap_free_batch(void **ptrs, size_t n);
+/*orders pointers by address for mm_free_batch*/
+static int ptr_cmp(const void *a, const void *b);
+/*these functions create arenas, bind threads to them and lock them*/
+static int arena_init(void);
+static int arena_create(arena_t *a);
+static void arena_init_locks(arena_t *a);
+static arena_t *arena_bind(void);
+inline static arena_t *arena_of(void *p);
+inline static arena_t *thread_arena(void);
+inline static void arena_lock(arena_t *a);
+inline static void arena_unlock(void);
+/*these functions pass blocks freed by other threads back to their arena*/
+inline static void remote_free(arena_t *a, void *bp);
+static void remote_drain(void);
+/*these functions manage the per-thread caches*/
+inline static int tc_index(size_t size);
+inline static int tc_index_of(arena_t *a, void *bp);
+/*frees a block of arena a that goes back to cache bin tc*/
+inline static void free_block(arena_t *a, void *bp, int tc);
+inline static void tcache_reset(void);
+static void tcache_init_key(void);
+static void tcache_unlink(void);
+/*sets everything up when the first allocation beats mm_init()*/
+static void mm_init_once(void);
+static void *tcache_refill(arena_t *a, int tc, size_t size);
+/*allocates from the CPU's or the thread's cache*/
+inline static void *cache_malloc(arena_t *a, int tc, size_t size);
+static void tcache_flush(int tc, int n);
+/*these functions move batches through the per-bin transfer caches*/
+static int central_get(arena_t *a, int tc, size_t size, void **batch, int n);
+static void central_put(arena_t *a, int tc, void **batch, int n);
+static void central_drain(arena_t *a);
+static void tcache_exit(void *arg);
+/*these functions keep the allocator usable in the child of a fork*/
+static void atfork_init(void);
+static void atfork_prepare(void);
+static void atfork_parent(void);
+static void atfork_child(void);
+#ifdef RSEQ
+/*these functions manage the per-CPU caches*/
+inline static int cpucache_usable(void);
+inline static void *cpucache_pop(int tc);
+inline static int cpucache_push(int tc, void *bp);
+static void *cpucache_refill(arena_t *a, int tc, size_t size);
+static void cpucache_flush(int tc, int n);
+#endif
+/*shrinks the heap down to pad free bytes at the top*/
+static size_t trim_top(size_t pad);
+/*releases the free memory of the current arena*/
+static int trim_arena(size_t pad);
+/*releases the free memory of every arena*/
+static int trim_arenas(size_t pad);
+/*these functions run the maintenance thread*/
+static void *bg_main(void *arg);
+inline static void bg_wake(void);
+/*these functions clear memory, streaming past the cache for large blocks*/
+inline static void zero_block(void *p, size_t n);
+#ifdef __x86_64__
+static void zero_sse2(void *p, size_t n);
+static void zero_avx2(void *p, size_t n);
+#endif
+/*frees every fast bin block for real, coalescing as it goes*/
+inline static void consolidate_fastbins(void);
+/*finds a free block for an aligned request, growing the heap if needed*/
+inline static void *get_free_block(size_t asize, size_t align);
+/*allocates a block whose payload is aligned to align bytes*/
+static void *malloc_aligned(size_t align, size_t size);
+/*the work of the aligned entry points, in the thread's arena*/
+static void *aligned_malloc(size_t align, size_t size);
+/*these functions hand out and take back slab slots*/
+static void *slab_alloc(size_t size);
+static void slab_free(void *ptr);
+static int slab_release(void);
+/*these functions manage blocks mapped outside the heap*/
+static void *huge_alloc(size_t size);
+static void huge_free(void *ptr);
+static void *huge_realloc(void *ptr, size_t size);
+static int huge_find(void *ptr);
+static void huge_unmap(int i);
+/*grows an allocated block without copying when its neighbours allow*/
+static void *grow_in_place(void *ptr, size_t oldsize, size_t asize);
+#ifndef TLSF
+/*searches one segregated list according to the placement policy*/
+inline static char *scan_class(int cls, size_t asize, unsigned *budget);
+#endif
 /*coalesces multiple blocks*/
 inline static void *coalesce(void *bp);
 /*these functions are used to add/remove from the freelist*/
 inline static void removeFromFreeList(char *bp);
 inline static void addToFreeList(char *bp);
+/*maps a block size to the index of its segregated list*/
+inline static int size_class(size_t size);
+/*these functions keep the non-empty list bitmaps up to date*/
+inline static void map_class(int cls);
+inline static void unmap_class(int cls);
+/*these functions maintain the red-black tree of large free blocks*/
+inline static void tree_insert(unsigned z);
+inline static void tree_delete(unsigned z);
+inline static void *tree_best_fit(size_t asize);
 /*these functions are used for debugging*/
 inline static void printblock(void *bp); /*prints a block*/ 
 inline static void checkblock(void *bp); /*checks block's consistency*/
 inline static void checkFreeList(); /*checks consistency of the freelist*/
+inline static void checkFastBins(); /*checks consistency of the fast bins*/
+inline static void checkSlabs(); /*checks consistency of the slabs*/
+inline static void checkArena(int verbose); /*checks the current arena*/
+inline static void checkRemote(); /*checks the remote free stack*/
+inline static void checkCentral(arena_t *a); /*checks the transfer caches*/
+inline static void checkHuge(); /*checks consistency of the huge table*/
+static int checkTree(unsigned n, unsigned parent, int *count); /*checks the tree*/
 
 /* 
- * mm_init - Initialize the memory manager 
+ * mm_init - Initialize the memory manager. Every arena created so far 
+ *      starts over with an empty heap at the break of its region.
  */
 int mm_init(void) 
 {
-	/* Create the initial empty heap */
-	if ((heap_listp = mem_sbrk(2*DSIZE)) == (void *)-1) 
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int i;
+	/* huge blocks left over from a previous heap are unmapped, and blocks 
+	   threads still cache from it are dropped */
+	while(huge_count > 0)
+		huge_free(huge_table[0].addr);
+	heap_generation++;
+	tcaches = NULL;
+	pthread_once(&atfork_once, atfork_init);
+#ifdef __x86_64__
+	__builtin_cpu_init();
+	zero_stream = __builtin_cpu_supports("avx2") ? zero_avx2 : zero_sse2;
+#endif
+#ifdef RSEQ
+	/* CPU caches are mapped once and emptied on every init */
+	if (cpucaches == NULL && __rseq_size != 0) {
+		num_cpucaches = sysconf(_SC_NPROCESSORS_CONF);
+		cpucaches = mmap(NULL, num_cpucaches * sizeof(cpucache_t), 
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (num_cpucaches <= 0 || cpucaches == MAP_FAILED)
+			cpucaches = NULL;
+	}
+	else if (cpucaches != NULL)
+		madvise(cpucaches, num_cpucaches * sizeof(cpucache_t), MADV_DONTNEED);
+#endif
+
+	arena_limit = (cpus > 0 && cpus < NUM_ARENAS) ? cpus : NUM_ARENAS;
+	next_arena = 0;
+	/* the first arena grows in memlib's default region */
+	if (arena_count == 0) {
+		arenas[0].region = mem_region_default();
+		arena_init_locks(&arenas[0]);
+		arena_count = 1;
+	}
+	/* the other regions are gone if memlib was initialized anew */
+	for (i = 1; i < arena_count; i++)
+		if (arenas[i].region->heap == NULL)
+			arenas[i].region = NULL;
+	for (i = 0; i < arena_count; i++)
+		if (arena_create(&arenas[i]) < 0)
+			return -1;
+	return 0;
+}
+
+/*
+ * arena_init - Create the initial empty heap of the current arena
+ */
+static int arena_init(void)
+{
+	char *bp = mem_region_sbrk(arena->region, 2*DSIZE);
+	int i;
+	if (bp == (void *)-1) 
 		return -1;
-	PUT(heap_listp, 0);                          /* Alignment padding */
-	PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */ 
-	PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
-	PUT(heap_listp + (3*WSIZE), PACK(0, 1));     /* Epilogue header */
-	heap_listp += (2*WSIZE);                 
-	freelist = 0;
+	PUT(bp, 0);                          /* Alignment padding */
+	PUT(bp + (1*WSIZE), PACK(DSIZE, 1 | PREV_ALLOC)); /* Prologue header */ 
+	PUT(bp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
+	PUT(bp + (3*WSIZE), PACK(0, 1 | PREV_ALLOC)); /* Epilogue header */
+	arena->heap_listp = bp + (2*WSIZE);                 
+	memset(arena->freelists, 0, sizeof(arena->freelists));
+#ifdef TLSF
+	arena->fl_bitmap = 0;
+	memset(arena->sl_bitmap, 0, sizeof(arena->sl_bitmap));
+#else
+	arena->classmap = 0;
+#endif
+	arena->tree_root = 0;
+	arena->trim_next = NULL;
+	memset(arena->rovers, 0, sizeof(arena->rovers));
+	memset(arena->fastbins, 0, sizeof(arena->fastbins));
+	arena->fast_count = 0;
+	memset(arena->slab_partial, 0, sizeof(arena->slab_partial));
+	memset(arena->slab_pages, 0, sizeof(arena->slab_pages));
+	arena->remote = NULL;
+	for (i = 0; i < TC_BINS; i++)
+		arena->central[i].count = 0;
 
 	/* Extend the empty heap with a free block of CHUNKSIZE bytes */
+	arena->chunk = CHUNKSIZE;
+	arena->stable = 0;
 	if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
 		return -1;
 	return 0;
 }
 
+/*
+ * arena_create - Give arena a a region, unless it has one already, and 
+ *      an empty heap in it
+ */
+static int arena_create(arena_t *a)
+{
+	int ret;
+	if (a->region == NULL) {
+		if ((a->region = mem_region_new()) == NULL)
+			return -1;
+		arena_init_locks(a);
+	}
+	arena_lock(a);
+	ret = arena_init();
+	arena_unlock();
+	return ret;
+}
+
+/*
+ * arena_init_locks - Initialize the arena lock and the bin locks of a
+ */
+static void arena_init_locks(arena_t *a)
+{
+	int i;
+	pthread_mutex_init(&a->lock, NULL);
+	for (i = 0; i < TC_BINS; i++)
+		pthread_mutex_init(&a->central[i].lock, NULL);
+}
+
+/*
+ * arena_bind - Pick the arena for a thread that has none, round-robin, 
+ *      creating it on its first turn. When no arena can be created the 
+ *      thread shares one of the existing ones. The thread's cache joins 
+ *      the list a forked child reclaims from.
+ */
+static arena_t *arena_bind(void)
+{
+	int i;
+	pthread_mutex_lock(&arenas_lock);
+	tcache.prev = NULL;
+	tcache.next = tcaches;
+	if (tcaches != NULL)
+		tcaches->prev = &tcache;
+	tcaches = &tcache;
+	i = next_arena++ % arena_limit;
+	if (i >= arena_count) {
+		if (arena_create(&arenas[arena_count]) == 0) {
+			i = arena_count;
+			/* free() looks for arenas without arenas_lock */
+			__atomic_store_n(&arena_count, arena_count + 1, __ATOMIC_RELEASE);
+		}
+		else
+			i %= arena_count;
+	}
+	pthread_mutex_unlock(&arenas_lock);
+	return &arenas[i];
+}
+
+/*
+ * arena_of - The arena whose region holds p, or NULL if p is a huge block. 
+ *      The calling thread's own arena is tried first.
+ */
+inline static arena_t *arena_of(void *p)
+{
+	arena_t *a = tcache.arena;
+	int i, n;
+	if (a != NULL && IN_ARENA(a, p))
+		return a;
+	n = __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++)
+		if (IN_ARENA(&arenas[i], p))
+			return &arenas[i];
+	return NULL;
+}
+
+/*
+ * thread_arena - The arena the calling thread allocates from. Binds the 
+ *      thread to one on first use, and makes sure its cache is flushed 
+ *      when it exits.
+ */
+inline static arena_t *thread_arena(void)
+{
+	/* before the generation check, as a first mm_init() bumps it */
+	if (tcache.arena == NULL)
+		pthread_once(&init_once, mm_init_once);
+	if (tcache.generation != heap_generation)
+		tcache_reset();
+	if (tcache.arena == NULL) {
+		pthread_once(&tcache_once, tcache_init_key);
+		pthread_setspecific(tcache_key, &tcache);
+		tcache.arena = arena_bind();
+	}
+	return tcache.arena;
+}
+
+/*
+ * mm_init_once - Initialize the memory system and the heap for a process 
+ *      that allocates before calling mm_init(), as one does when the 
+ *      allocator replaces libc's. mm_init() sets arena_limit even if it 
+ *      fails, so arena_bind() always has an arena to hand out, though 
+ *      one that cannot grow.
+ */
+static void mm_init_once(void)
+{
+	if (arena_limit != 0)
+		return;
+	if (mem_region_default()->heap == NULL)
+		mem_init();
+	mm_init();
+}
+
+/*
+ * arena_lock - Lock arena a and make it the one the heap code works on
+ */
+inline static void arena_lock(arena_t *a)
+{
+	pthread_mutex_lock(&a->lock);
+	arena = a;
+}
+
+/*
+ * arena_unlock - Unlock the arena the calling thread holds
+ */
+inline static void arena_unlock(void)
+{
+	arena_t *a = arena;
+	arena = NULL;
+	pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * remote_free - Push bp on the remote stack of its arena a, which the 
+ *      calling thread is not bound to. Never blocks.
+ */
+inline static void remote_free(arena_t *a, void *bp)
+{
+	void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+	do
+		*(void **)bp = head;
+	while (!__atomic_compare_exchange_n(&a->remote, &head, bp, 1, 
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * remote_drain - Take the whole remote stack of the current arena in one 
+ *      exchange and free its blocks
+ */
+static void remote_drain(void)
+{
+	void *bp, *next;
+	if (__atomic_load_n(&arena->remote, __ATOMIC_RELAXED) == NULL)
+		return;
+	bp = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+	for (; bp != NULL; bp = next) {
+		next = *(void **)bp;
+		heap_free(bp);
+	}
+}
+
+/*
+ * mm_set_policy - Select how the segregated lists are searched. 
+ *      candidates is the number of fitting blocks MM_GOOD_FIT weighs 
+ *      before settling, 0 keeps the current value. The large block tree 
+ *      is always searched best fit. Returns -1 for an unknown policy, 
+ *      and for anything but first fit in TLSF builds, whose bins already 
+ *      decide placement.
+ */
+int mm_set_policy(int newpolicy, unsigned candidates)
+{
+	int i;
+	if(newpolicy < MM_FIRST_FIT || newpolicy > MM_GOOD_FIT)
+		return -1;
+#ifdef TLSF
+	if(newpolicy != MM_FIRST_FIT)
+		return -1;
+#endif
+	/* no arena may be searching while the policy changes */
+	pthread_mutex_lock(&arenas_lock);
+	for(i = 0; i < arena_count; i++)
+		pthread_mutex_lock(&arenas[i].lock);
+	policy = newpolicy;
+	if(candidates != 0)
+		good_fit_candidates = candidates;
+	for(i = arena_count - 1; i >= 0; i--)
+		pthread_mutex_unlock(&arenas[i].lock);
+	pthread_mutex_unlock(&arenas_lock);
+	return 0;
+}
+
 /* 
  * extend_heap - Extend heap with free block and return its block pointer
  */
 inline static void *extend_heap(size_t words) 
 {
-	char *bp;
-	size_t size;
+	char *bp, *new;
+	size_t size, prev, zeroed;
 
 	/* Allocate an even number of words to maintain alignment */
 	size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
-	if ((long)(bp = mem_sbrk(size)) == -1)  
+	if ((long)(bp = mem_region_sbrk(arena->region, size)) == -1)  
 		return NULL;    
 
-	/* Initialize free block header/footer and the epilogue header */
-	PUT(HDRP(bp), PACK(size, 0));         /* Free block header */ 
-	PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
+	/* Initialize free block header/footer and the epilogue header. The old 
+	   epilogue header knows whether the last block is allocated */
+	prev = GET_PREV_ALLOC(HDRP(bp));
+	PUT(HDRP(bp), PACK(size, prev));      /* Free block header */ 
+	PUT(FTRP(bp), PACK(size, prev));      /* Free block footer */
 	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
 	/* Initialize and Coalesce */
 	PUT(bp, 0);
 	PUT(bp+WSIZE, 0);
+	zeroed = prev || (GET(bp - DSIZE) & ZEROED);
+	new = bp;
 	bp = coalesce(bp);
+	/* the new memory is zero, and a zeroed last block it merged with 
+	   stays so once the footer and header between them are cleared */
+	if (zeroed) {
+		if (!prev) {
+			PUT(new - DSIZE, 0);
+			PUT(HDRP(new), 0);
+		}
+		PUT(HDRP(bp), GET(HDRP(bp)) | ZEROED);
+		PUT(FTRP(bp), GET(HDRP(bp)));
+	}
 	addToFreeList( bp );
 	return bp;
 }
 
-
-/* 
- * mm_free - Free a block 
+
+/* 
+ * heap_free - Free a block of the current arena
+ */
+static void heap_free(void *bp)
+{
+	if(bp == 0) 
+		return;
+	if(!IN_ARENA(arena, bp)){
+		huge_free(bp);
+		return;
+	}
+	if(IS_SLAB_PTR(arena, bp)){
+		slab_free(bp);
+		return;
+	}
+
+	size_t size = GET_SIZE(HDRP(bp));
+
+/*small blocks go on their fast bin untouched*/
+	if(IS_FAST_SIZE(size)){
+		PUT(bp, arena->fastbins[FAST_INDEX(size)]);
+		arena->fastbins[FAST_INDEX(size)] = GET_ADDR_INDEX(bp);
+		if(++arena->fast_count > FAST_BUDGET){
+			if(__atomic_load_n(&bg_running, __ATOMIC_RELAXED))
+				bg_wake();
+			else
+				consolidate_fastbins();
+		}
+		return;
+	}
+/*new free block initialized*/
+	PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), GET(HDRP(bp)));
+	CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	PUT(bp, 0);
+	PUT(bp + WSIZE, 0);
+/*coalescing and then adding it to the freelist*/
+	bp = coalesce(bp);
+	addToFreeList(bp);
+/*give a large enough free top back to the system*/
+	if(GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 
+		&& GET_SIZE(HDRP(bp)) >= TRIM_THRESHOLD){
+		if(__atomic_load_n(&bg_running, __ATOMIC_RELAXED))
+			bg_wake();
+		else
+			trim_top(TRIM_PAD);
+	}
+}
+
+/*
+ * trim_top - If the last block is free, shrink it to pad bytes, or drop 
+ *      it altogether, and lower the break to match. Returns the number 
+ *      of bytes released.
+ */
+static size_t trim_top(size_t pad)
+{
+	char *epilogue, *bp;
+	size_t size, keep, release, total = 0;
+	/* the break moves by an int at a time, so a top of more than 
+	   INT_MAX bytes goes back in several steps */
+	for(;;){
+		epilogue = (char *)mem_region_hi(arena->region) + 1;
+		if(GET_PREV_ALLOC(HDRP(epilogue)))
+			break;
+		bp = PREV_BLKP(epilogue);
+		size = GET_SIZE(HDRP(bp));
+		keep = (pad + DSIZE - 1) & ~(size_t)(DSIZE - 1);
+		if(keep != 0 && keep < 2*DSIZE)
+			keep = 2*DSIZE;
+		if(size <= keep || size - keep < mem_pagesize())
+			break;
+		release = size - keep;
+		if(release > INT_MAX){
+			release = INT_MAX & ~(mem_pagesize() - 1);
+			keep = size - release;
+		}
+		/* the links go above the break, so unlink first, and leave the 
+		   block as it was if the break does not move */
+		removeFromFreeList(bp);
+		if(mem_region_sbrk(arena->region, -(int)release) == (void *)-1){
+			addToFreeList(bp);
+			break;
+		}
+		if(keep != 0){
+			PUT(HDRP(bp), PACK(keep, GET(HDRP(bp)) & (PREV_ALLOC | ZEROED)));
+			PUT(FTRP(bp), GET(HDRP(bp)));
+			addToFreeList(bp);
+			PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+		}
+		else
+			PUT(HDRP(bp), PACK(0, 1 | PREV_ALLOC));
+		total += release;
+	}
+	return total;
+}
+
+/*
+ * mm_trim - Return free memory to the system: in every arena shrink the 
+ *      top of the heap to pad free bytes and release the whole pages 
+ *      inside every other free block. A released page is zero-filled on 
+ *      its next use; the header, list or tree links and footer stay 
+ *      resident. The calling thread's cache, the cache of the CPU it 
+ *      runs on and the transfer caches are flushed first. Returns 1 if 
+ *      any memory was released, 0 otherwise.
+ */
+int mm_trim(size_t pad)
+{
+	int tc;
+	if(tcache.generation == heap_generation)
+		for(tc = 0; tc < TC_BINS; tc++)
+			tcache_flush(tc, tcache.count[tc]);
+#ifdef RSEQ
+	if(cpucache_usable())
+		for(tc = 0; tc < TC_BINS; tc++)
+			cpucache_flush(tc, TC_LIMIT);
+#endif
+	return trim_arenas(pad);
+}
+
+/*
+ * mm_background - Start the maintenance thread with a pass every period 
+ *      milliseconds, or change the period of the running one; a period 
+ *      of 0 stops it. Returns 0 on success, -1 if the thread could not 
+ *      be started.
+ */
+int mm_background(unsigned period)
+{
+	pthread_t thread;
+	int ret = 0;
+	pthread_mutex_lock(&bg_lock);
+	bg_period = period;
+	if(period != 0 && !bg_running){
+		bg_stop = 0;
+		if(pthread_create(&bg_thread, NULL, bg_main, NULL) != 0)
+			ret = -1;
+		else
+			__atomic_store_n(&bg_running, 1, __ATOMIC_RELAXED);
+	}
+	else if(period == 0 && bg_running){
+		bg_stop = 1;
+		pthread_cond_signal(&bg_cond);
+		thread = bg_thread;
+		pthread_mutex_unlock(&bg_lock);
+		pthread_join(thread, NULL);
+		pthread_mutex_lock(&bg_lock);
+		/* free() does the work itself again */
+		__atomic_store_n(&bg_running, 0, __ATOMIC_RELAXED);
+	}
+	else if(bg_running)
+		pthread_cond_signal(&bg_cond);
+	pthread_mutex_unlock(&bg_lock);
+	return ret;
+}
+
+/*
+ * trim_arena - mm_trim() for the current arena. Free blocks marked ZEROED 
+ *      have no pages left to release and are skipped. Every TRIM_BATCH 
+ *      free blocks the walk lets go of the arena lock for a moment; if 
+ *      the block it stopped at has left the free lists by the time it 
+ *      has the lock back, the rest of the heap waits for the next trim.
+ */
+static int trim_arena(size_t pad)
+{
+	char *bp, *start, *end;
+	size_t pagesize = mem_pagesize();
+	arena_t *a = arena;
+	int released, n = 0;
+	released = slab_release();
+	if(arena->fast_count != 0)
+		consolidate_fastbins();
+	released |= trim_top(pad) != 0;
+	for(bp = arena->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+		if(GET_ALLOC(HDRP(bp)))
+			continue;
+		if(++n == TRIM_BATCH){
+			n = 0;
+			arena->trim_next = bp;
+			arena_unlock();
+			arena_lock(a);
+			if((bp = arena->trim_next) == NULL)
+				break;
+			arena->trim_next = NULL;
+		}
+		if(GET_SIZE(HDRP(bp)) < 2*pagesize || (GET(HDRP(bp)) & ZEROED))
+			continue;
+		start = (char *)(((size_t)bp + 4*WSIZE + pagesize - 1) 
+			& ~(pagesize - 1));
+		end = (char *)((size_t)FTRP(bp) & ~(pagesize - 1));
+		if(start < end){
+			madvise(start, end - start, MADV_DONTNEED);
+			released = 1;
+			/* clear what is left around the released pages once, so 
+			   that calloc() can hand the block out as it is */
+			memset(bp + 4*WSIZE, 0, start - (bp + 4*WSIZE));
+			memset(end, 0, FTRP(bp) - end);
+			PUT(HDRP(bp), GET(HDRP(bp)) | ZEROED);
+			PUT(FTRP(bp), GET(HDRP(bp)));
+		}
+	}
+	return released;
+}
+
+/*
+ * trim_arenas - Drain the transfer caches and remote stacks of every 
+ *      arena and trim it down to pad free bytes
+ */
+static int trim_arenas(size_t pad)
+{
+	int released = 0, i, n;
+	n = __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE);
+	for(i = 0; i < n; i++){
+		central_drain(&arenas[i]);
+		arena_lock(&arenas[i]);
+		remote_drain();
+		released |= trim_arena(pad);
+		arena_unlock();
+	}
+	return released;
+}
+
+/*
+ * bg_main - The maintenance thread: a pass over all arenas every 
+ *      bg_period milliseconds, or sooner when free() wakes it
+ */
+static void *bg_main(void *arg)
+{
+	struct timespec deadline;
+	(void)arg;
+	pthread_mutex_lock(&bg_lock);
+	while(!bg_stop){
+		if(!__atomic_load_n(&bg_pressure, __ATOMIC_RELAXED)){
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += bg_period / 1000;
+			deadline.tv_nsec += (long)(bg_period % 1000) * 1000000;
+			if(deadline.tv_nsec >= 1000000000){
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&bg_cond, &bg_lock, &deadline);
+			if(bg_stop)
+				break;
+		}
+		__atomic_store_n(&bg_pressure, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&bg_lock);
+		trim_arenas(TRIM_PAD);
+		pthread_mutex_lock(&bg_lock);
+	}
+	pthread_mutex_unlock(&bg_lock);
+	return NULL;
+}
+
+/*
+ * bg_wake - Hand deferred work to the maintenance thread. Called with an 
+ *      arena lock held, so it does not take bg_lock; a wakeup lost to the 
+ *      race only waits for the next period.
+ */
+inline static void bg_wake(void)
+{
+	if(!__atomic_exchange_n(&bg_pressure, 1, __ATOMIC_RELAXED))
+		pthread_cond_signal(&bg_cond);
+}
+
+/*
+ * consolidate_fastbins - Empty all fast bins into the free lists. 
+ *      A block whose neighbour is still binned looks allocated and is 
+ *      merged with it once that neighbour's turn comes.
+ */
+inline static void consolidate_fastbins(void)
+{
+	char *bp;
+	size_t size;
+	int i;
+	for(i = 0; i < NUM_FAST; i++){
+		while(arena->fastbins[i] != 0){
+			bp = GET_ADDR(arena->fastbins[i]);
+			arena->fastbins[i] = GET(bp);
+			size = GET_SIZE(HDRP(bp));
+			PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+			PUT(FTRP(bp), GET(HDRP(bp)));
+			CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+			bp = coalesce(bp);
+			addToFreeList(bp);
+		}
+	}
+	arena->fast_count = 0;
+}
+#ifdef TLSF
+/*
+ *Returns the TLSF bin (fl * SL_COUNT + sl) a block of the given size 
+ *belongs to.
+ */
+inline static int size_class(size_t size){
+	int msb;
+	if(size < (1 << FL_SHIFT))
+		return size / DSIZE;
+	msb = 31 - __builtin_clz((unsigned)size);
+	return (msb - FL_SHIFT + 1) * SL_COUNT 
+		+ ((size >> (msb - SL_LOG2)) ^ SL_COUNT);
+}
+
+inline static void map_class(int cls){
+	arena->sl_bitmap[cls / SL_COUNT] |= 1u << (cls % SL_COUNT);
+	arena->fl_bitmap |= 1u << (cls / SL_COUNT);
+}
+
+inline static void unmap_class(int cls){
+	arena->sl_bitmap[cls / SL_COUNT] &= ~(1u << (cls % SL_COUNT));
+	if(arena->sl_bitmap[cls / SL_COUNT] == 0)
+		arena->fl_bitmap &= ~(1u << (cls / SL_COUNT));
+}
+#else
+/*
+ *Returns the segregated list a block of the given size belongs to.
+ */
+inline static int size_class(size_t size){
+	int cls = (8*sizeof(unsigned) - 1) - __builtin_clz((unsigned)size) 
+		- MIN_CLASS_SHIFT;
+	if(size >= (1UL << 31) || cls >= NUM_CLASSES)
+		return NUM_CLASSES - 1;
+	return cls < 0 ? 0 : cls;
+}
+
+inline static void map_class(int cls){
+	arena->classmap |= 1u << cls;
+}
+
+inline static void unmap_class(int cls){
+	arena->classmap &= ~(1u << cls);
+}
+#endif
+
+/*
+ *This method adds a given block to its segregated freelist.
+ *It takes in the pointer to the first byte of the payload, 
+ *i.e. right after the header.
+ */
+inline static void addToFreeList(char *bp){
+	int cls;
+	unsigned head;
+	if(IS_TREE_SIZE(GET_SIZE(HDRP(bp)))){
+		tree_insert(GET_ADDR_INDEX(bp));
+		return;
+	}
+	cls = size_class(GET_SIZE(HDRP(bp)));
+	head = arena->freelists[cls];
+/*Putting the free block at the beginning of its list*/
+	PUT(bp, 0); /*set previous pointer to be zero*/
+	PUT(bp + WSIZE, head);
+/*connecting the prev pointer of the initial first node 
+  to bp*/ 
+	if(head != 0)
+		PUT(GET_ADDR(head) , GET_ADDR_INDEX(bp));
+/*setting the list head to bp*/
+	arena->freelists[cls] = GET_ADDR_INDEX(bp);
+	map_class(cls);
+	return;
+}
+
+/*
+ *This method removes a given block from its segregated freelist.
+ *It takes in the pointer to the first byte of the payload, 
+ *i.e. right after the header. The header must still hold the 
+ *size the block was added with.
+ */
+inline static void removeFromFreeList(char *bp){
+	int cls;
+	char* ptr;
+	unsigned prev, next;
+	/* a paused trim must not resume at a block that is gone */
+	if(bp == arena->trim_next)
+		arena->trim_next = NULL;
+	if(IS_TREE_SIZE(GET_SIZE(HDRP(bp)))){
+		tree_delete(GET_ADDR_INDEX(bp));
+		return;
+	}
+	cls = size_class(GET_SIZE(HDRP(bp)));
+/*storing the previous and the next ptr*/
+	ptr = bp + WSIZE;
+	prev = GET(bp);
+	next = GET(ptr);
+	if(prev != 0 && next != 0){ /*case 1:*/
+		PUT(((char *)GET_ADDR(prev) + WSIZE), next); 	
+		PUT((GET_ADDR(next)), prev);
+	}
+	else if(prev == 0 && next != 0){ /*case 2:*/	
+		arena->freelists[cls] = next;
+		PUT(GET_ADDR(next) , 0);
+	}	
+	else if(prev != 0 && next == 0){ /*case 3:*/	
+		PUT(((char *)GET_ADDR(prev) + WSIZE), 0);
+	}
+	else if(prev == 0 && next == 0){ /*case 4:*/
+		arena->freelists[cls] = 0;
+		unmap_class(cls);
+	}
+/*keep the next fit rover on a block that is still in the list*/
+	if(arena->rovers[cls] == GET_ADDR_INDEX(bp))
+		arena->rovers[cls] = next;
+}
+/*
+ *Orders two tree nodes by size, breaking ties by address.
+ */
+inline static int tree_less(unsigned a, unsigned b){
+	return T_SIZE(a) < T_SIZE(b) || (T_SIZE(a) == T_SIZE(b) && a < b);
+}
+
+/*
+ *Replaces the child link that points at old by one pointing at child.
+ */
+inline static void tree_relink(unsigned parent, unsigned old, unsigned child){
+	if(parent == 0)
+		arena->tree_root = child;
+	else if(T_LEFT(parent) == old)
+		T_SET_LEFT(parent, child);
+	else
+		T_SET_RIGHT(parent, child);
+	if(child != 0)
+		T_SET_PARENT(child, parent);
+}
+
+inline static void tree_rotate_left(unsigned x){
+	unsigned y = T_RIGHT(x);
+	T_SET_RIGHT(x, T_LEFT(y));
+	if(T_LEFT(y) != 0)
+		T_SET_PARENT(T_LEFT(y), x);
+	tree_relink(T_PARENT(x), x, y);
+	T_SET_LEFT(y, x);
+	T_SET_PARENT(x, y);
+}
+
+inline static void tree_rotate_right(unsigned x){
+	unsigned y = T_LEFT(x);
+	T_SET_LEFT(x, T_RIGHT(y));
+	if(T_RIGHT(y) != 0)
+		T_SET_PARENT(T_RIGHT(y), x);
+	tree_relink(T_PARENT(x), x, y);
+	T_SET_RIGHT(y, x);
+	T_SET_PARENT(x, y);
+}
+
+/*
+ *Inserts the free block at offset z into the large block tree.
+ */
+inline static void tree_insert(unsigned z){
+	unsigned parent = 0, n = arena->tree_root, p, g, u;
+	while(n != 0){
+		parent = n;
+		n = tree_less(z, n) ? T_LEFT(n) : T_RIGHT(n);
+	}
+	T_SET_LEFT(z, 0);
+	T_SET_RIGHT(z, 0);
+	T_SET_PARENT(z, parent);
+	T_SET_COLOR(z, RB_RED);
+	if(parent == 0)
+		arena->tree_root = z;
+	else if(tree_less(z, parent))
+		T_SET_LEFT(parent, z);
+	else
+		T_SET_RIGHT(parent, z);
+/*restore the red-black properties walking up from z*/
+	while(T_IS_RED(T_PARENT(z))){
+		p = T_PARENT(z);
+		g = T_PARENT(p);
+		if(p == T_LEFT(g)){
+			u = T_RIGHT(g);
+			if(T_IS_RED(u)){
+				T_SET_COLOR(p, RB_BLACK);
+				T_SET_COLOR(u, RB_BLACK);
+				T_SET_COLOR(g, RB_RED);
+				z = g;
+				continue;
+			}
+			if(z == T_RIGHT(p)){
+				z = p;
+				tree_rotate_left(z);
+				p = T_PARENT(z);
+			}
+			T_SET_COLOR(p, RB_BLACK);
+			T_SET_COLOR(g, RB_RED);
+			tree_rotate_right(g);
+		}
+		else{
+			u = T_LEFT(g);
+			if(T_IS_RED(u)){
+				T_SET_COLOR(p, RB_BLACK);
+				T_SET_COLOR(u, RB_BLACK);
+				T_SET_COLOR(g, RB_RED);
+				z = g;
+				continue;
+			}
+			if(z == T_LEFT(p)){
+				z = p;
+				tree_rotate_right(z);
+				p = T_PARENT(z);
+			}
+			T_SET_COLOR(p, RB_BLACK);
+			T_SET_COLOR(g, RB_RED);
+			tree_rotate_left(g);
+		}
+	}
+	T_SET_COLOR(arena->tree_root, RB_BLACK);
+}
+
+/*
+ *Removes the free block at offset z from the large block tree.
+ */
+inline static void tree_delete(unsigned z){
+	unsigned y = z, x, xp, w;
+	unsigned color = T_COLOR(z);
+	if(T_LEFT(z) == 0){
+		x = T_RIGHT(z);
+		xp = T_PARENT(z);
+		tree_relink(xp, z, x);
+	}
+	else if(T_RIGHT(z) == 0){
+		x = T_LEFT(z);
+		xp = T_PARENT(z);
+		tree_relink(xp, z, x);
+	}
+	else{
+	/*z has two children, splice out its successor y in its place*/
+		for(y = T_RIGHT(z); T_LEFT(y) != 0; y = T_LEFT(y))
+			;
+		color = T_COLOR(y);
+		x = T_RIGHT(y);
+		if(T_PARENT(y) == z)
+			xp = y;
+		else{
+			xp = T_PARENT(y);
+			tree_relink(xp, y, x);
+			T_SET_RIGHT(y, T_RIGHT(z));
+			T_SET_PARENT(T_RIGHT(y), y);
+		}
+		tree_relink(T_PARENT(z), z, y);
+		T_SET_LEFT(y, T_LEFT(z));
+		T_SET_PARENT(T_LEFT(y), y);
+		T_SET_COLOR(y, T_COLOR(z));
+	}
+	if(color == RB_RED)
+		return;
+/*a black node was removed, push the extra black up from x*/
+	while(x != arena->tree_root && !T_IS_RED(x)){
+		if(x == T_LEFT(xp)){
+			w = T_RIGHT(xp);
+			if(T_IS_RED(w)){
+				T_SET_COLOR(w, RB_BLACK);
+				T_SET_COLOR(xp, RB_RED);
+				tree_rotate_left(xp);
+				w = T_RIGHT(xp);
+			}
+			if(!T_IS_RED(T_LEFT(w)) && !T_IS_RED(T_RIGHT(w))){
+				T_SET_COLOR(w, RB_RED);
+				x = xp;
+				xp = T_PARENT(x);
+				continue;
+			}
+			if(!T_IS_RED(T_RIGHT(w))){
+				T_SET_COLOR(T_LEFT(w), RB_BLACK);
+				T_SET_COLOR(w, RB_RED);
+				tree_rotate_right(w);
+				w = T_RIGHT(xp);
+			}
+			T_SET_COLOR(w, T_COLOR(xp));
+			T_SET_COLOR(xp, RB_BLACK);
+			T_SET_COLOR(T_RIGHT(w), RB_BLACK);
+			tree_rotate_left(xp);
+		}
+		else{
+			w = T_LEFT(xp);
+			if(T_IS_RED(w)){
+				T_SET_COLOR(w, RB_BLACK);
+				T_SET_COLOR(xp, RB_RED);
+				tree_rotate_right(xp);
+				w = T_LEFT(xp);
+			}
+			if(!T_IS_RED(T_LEFT(w)) && !T_IS_RED(T_RIGHT(w))){
+				T_SET_COLOR(w, RB_RED);
+				x = xp;
+				xp = T_PARENT(x);
+				continue;
+			}
+			if(!T_IS_RED(T_LEFT(w))){
+				T_SET_COLOR(T_RIGHT(w), RB_BLACK);
+				T_SET_COLOR(w, RB_RED);
+				tree_rotate_left(w);
+				w = T_LEFT(xp);
+			}
+			T_SET_COLOR(w, T_COLOR(xp));
+			T_SET_COLOR(xp, RB_BLACK);
+			T_SET_COLOR(T_LEFT(w), RB_BLACK);
+			tree_rotate_right(xp);
+		}
+		x = arena->tree_root;
+	}
+	if(x != 0)
+		T_SET_COLOR(x, RB_BLACK);
+}
+
+/*
+ *Returns the smallest (and among those the lowest) tree block with at 
+ *least asize bytes, or NULL if there is none.
+ */
+inline static void *tree_best_fit(size_t asize){
+	unsigned n = arena->tree_root, best = 0;
+	while(n != 0){
+		if(T_SIZE(n) >= asize){
+			best = n;
+			n = T_LEFT(n);
+		}
+		else
+			n = T_RIGHT(n);
+	}
+	return best ? GET_ADDR(best) : NULL;
+}
+/*
+ * coalesce - Boundary tag coalescing. Return ptr to coalesced block
+ */
+inline static void *coalesce(void *bp) 
+{
+	size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+	size_t size = GET_SIZE(HDRP(bp));
+
+	if (prev_alloc && next_alloc) {            /* Case 1 */
+/*Nothing to be done here*/
+	}
+/*only the next block is free so add them together.*/
+	else if (prev_alloc && !next_alloc) {      /* Case 2 */
+	/*remove next block from the free list*/
+		removeFromFreeList(NEXT_BLKP(bp)); 
+		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+		PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+		PUT(FTRP(bp), GET(HDRP(bp)));
+	}
+/*only the previous block is free so add them together*/
+	else if (!prev_alloc && next_alloc) {      /* Case 3 */
+		bp = PREV_BLKP(bp);
+/*remove prev block from the free list*/
+		removeFromFreeList(bp); 
+		size += GET_SIZE(HDRP(bp));
+		PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+		PUT(FTRP(bp), GET(HDRP(bp)));
+	}
+	else{                                     /* Case 4 */
+		size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
+			GET_SIZE(HDRP(NEXT_BLKP(bp)));
+		removeFromFreeList(NEXT_BLKP(bp));
+		bp = PREV_BLKP(bp);
+		removeFromFreeList(bp);
+		PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+		PUT(FTRP(bp), GET(HDRP(bp)));
+	}
+	return bp;
+}
+/*
+ * heap_malloc_batch - Allocate n blocks of size bytes each from the 
+ *      current arena. Each round takes one free block, big enough for the 
+ *      rest of the batch if there is one, and carves it up with a single 
+ *      free list update; when nothing fits the heap grows by the rest.
+ */
+static size_t heap_malloc_batch(size_t size, size_t n, void **out)
+{
+	size_t asize, csize, k, got = 0;
+	unsigned prev;
+	char *bp;
+	/* slabs and huge blocks have nothing to carve */
+	if (size == 0 || size <= SLAB_MAX || size >= HUGE_THRESHOLD 
+		|| size > (1UL << 31) - 2*DSIZE) {
+		while (got < n && (out[got] = heap_malloc(size)) != NULL)
+			got++;
+		return got;
+	}
+	asize = (size <= DSIZE) ? 2*DSIZE : ALIGN(size);
+	while (got < n && IS_FAST_SIZE(asize) 
+		&& arena->fastbins[FAST_INDEX(asize)] != 0) {
+		bp = GET_ADDR(arena->fastbins[FAST_INDEX(asize)]);
+		arena->fastbins[FAST_INDEX(asize)] = GET(bp);
+		arena->fast_count--;
+		out[got++] = bp;
+	}
+	while (got < n) {
+		/* a block size must fit in a header */
+		k = MIN(n - got, ((1UL << 30) / asize));
+		/* the heap only grows once no free block holds even one */
+		if ((bp = find_fit(k * asize)) == NULL && (bp = find_fit(asize)) == NULL
+			&& (bp = get_free_block(k * asize, DSIZE)) == NULL 
+			&& (k == 1 || (bp = get_free_block(asize, DSIZE)) == NULL))
+			break;
+		csize = GET_SIZE(HDRP(bp));
+		k = MIN(k, csize / asize);
+		prev = GET_PREV_ALLOC(HDRP(bp));
+		removeFromFreeList(bp);
+		for (; k > 1; k--, csize -= asize) {
+			PUT(HDRP(bp), PACK(asize, 1 | prev));
+			out[got++] = bp;
+			bp += asize;
+			prev = PREV_ALLOC;
+		}
+		/* the last block takes a remainder too small to stand alone */
+		out[got++] = bp;
+		if (csize - asize >= 2*DSIZE) {
+			PUT(HDRP(bp), PACK(asize, 1 | prev));
+			bp = NEXT_BLKP(bp);
+			PUT(HDRP(bp), PACK(csize - asize, PREV_ALLOC));
+			PUT(FTRP(bp), PACK(csize - asize, PREV_ALLOC));
+			addToFreeList(bp);
+		}
+		else {
+			PUT(HDRP(bp), PACK(csize, 1 | prev));
+			SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+		}
+	}
+	return got;
+}
+
+/*
+ * heap_free_batch - Free n blocks of the current arena, sorted by 
+ *      address. Each run of adjacent heap blocks is merged into one 
+ *      block first, so it is coalesced and listed once.
+ */
+static void heap_free_batch(void **ptrs, size_t n)
+{
+	char *bp;
+	size_t i = 0, size;
+	while (i < n) {
+		bp = ptrs[i++];
+		if (IS_SLAB_PTR(arena, bp)) {
+			heap_free(bp);
+			continue;
+		}
+		size = GET_SIZE(HDRP(bp));
+		while (i < n && (char *)ptrs[i] == bp + size 
+			&& !IS_SLAB_PTR(arena, ptrs[i]))
+			size += GET_SIZE(HDRP(ptrs[i++]));
+		PUT(HDRP(bp), PACK(size, 1 | GET_PREV_ALLOC(HDRP(bp))));
+		heap_free(bp);
+	}
+}
+
+/*
+ * ptr_cmp - qsort() order of two pointers by address
+ */
+static int ptr_cmp(const void *a, const void *b)
+{
+	char *p = *(char * const *)a, *q = *(char * const *)b;
+	return (p > q) - (p < q);
+}
+
+/*
+ * heap_realloc - Shrinks in place, grows in place when a neighbour or the 
+ *      heap top allows it and moves the block otherwise, within the 
+ *      current arena.
+ */
+static void *heap_realloc(void *ptr, size_t size)
+{
+	size_t oldsize, asize;
+	void *newptr;
+	
+	/* If oldptr is NULL, then this is just malloc. */
+	if(ptr == NULL) {
+		return heap_malloc(size);
+	}
+	
+	/* If size == 0 then this is just free, and we return NULL. */
+	if(size == 0) {
+		heap_free(ptr);
+		return 0;
+	}
+	
+	/* Huge blocks are resized by remapping them */
+	if(!IN_ARENA(arena, ptr))
+		return huge_realloc(ptr, size);
+
+	/* Slab slots cannot change size, move out when the slot is too small */
+	if(IS_SLAB_PTR(arena, ptr)) {
+		oldsize = SLAB_OF(ptr)->objsize;
+		if(size <= oldsize)
+			return ptr;
+		if((newptr = heap_malloc(size)) == NULL)
+			return 0;
+		memcpy(newptr, ptr, oldsize);
+		slab_free(ptr);
+		return newptr;
+	}
+
+	oldsize = GET_SIZE(HDRP(ptr));
+	/* Too large for the heap, it can only move out to a mapping */
+	if(size > (1UL << 31) - 2*DSIZE)
+		return move_block(ptr, oldsize, size);
+	if(size <= DSIZE)
+		asize = 2*DSIZE;
+	else
+		asize = ALIGN(size);
+	/*oldsize is larger than or equal to asize need to shrink block*/
+	if(oldsize >= asize){
+		/*if difference to be shrunk is less than 16 bytes,
+			 then can't shrink*/
+		if(oldsize - asize < (2*DSIZE)){
+			return ptr;
+		}
+		/*else we shrink the block*/
+		else{
+			PUT(HDRP(ptr), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(ptr))));
+		/*store back the remaining space in the freelist*/
+			newptr = NEXT_BLKP(ptr);
+			PUT(HDRP(newptr), PACK(oldsize-asize , PREV_ALLOC));
+			PUT(FTRP(newptr), PACK(oldsize-asize , PREV_ALLOC));
+			CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(newptr)));
+			PUT(newptr , 0);
+			PUT(newptr + WSIZE, 0);
+			coalesce(newptr);
+			addToFreeList(newptr);
+			dbg_printf( "realloc() -> %p\n\n", ptr);
+			return ptr;
+		}
+	}
+	else if(asize > oldsize){
+		/* Grow without copying whenever the neighbours allow it, unless 
+		   the block is about to become huge and leave the heap */
+		if(size < HUGE_THRESHOLD 
+			&& (newptr = grow_in_place(ptr, oldsize, asize)) != NULL)
+			return newptr;
+		return move_block(ptr, oldsize, size);
+	}
+	return 0;
+}
+
+/*
+ * move_block - Move the heap block ptr of oldsize bytes to a new block 
+ *      of size bytes, in the heap or mapped on its own
+ */
+static void *move_block(void *ptr, size_t oldsize, size_t size)
+{
+	void *newptr = heap_malloc(size);
+	/* If realloc() fails the original block is left untouched  */
+	if(!newptr) {
+		return 0;
+	}
+	/* Copy the old data. */
+	memcpy(newptr, ptr, oldsize - WSIZE);
+	/* Free the old block. */
+	heap_free(ptr);
+	return newptr;
+}
+/*
+ * huge_alloc - Map a huge block of at least size bytes. Returns NULL with 
+ *      errno set to ENOMEM if the mapping fails or huge_table is full.
+ */
+static void *huge_alloc(size_t size)
+{
+	size_t len = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	char *addr;
+	if (len < size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	addr = mmap(NULL, len, PROT_READ | PROT_WRITE, 
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		return NULL;
+	pthread_mutex_lock(&huge_lock);
+	if (huge_count == HUGE_SLOTS) {
+		pthread_mutex_unlock(&huge_lock);
+		munmap(addr, len);
+		errno = ENOMEM;
+		return NULL;
+	}
+	huge_table[huge_count].addr = addr;
+	huge_table[huge_count].len = len;
+	huge_count++;
+	pthread_mutex_unlock(&huge_lock);
+	return addr;
+}
+
+/*
+ * huge_find - Return the huge_table slot of ptr, or -1 if it has none. 
+ *      The caller holds huge_lock.
+ */
+static int huge_find(void *ptr)
+{
+	int i;
+	for (i = 0; i < huge_count; i++)
+		if (huge_table[i].addr == ptr)
+			return i;
+	return -1;
+}
+
+/*
+ * huge_unmap - Unmap the huge block in slot i and drop it from huge_table. 
+ *      The caller holds huge_lock.
+ */
+static void huge_unmap(int i)
+{
+	munmap(huge_table[i].addr, huge_table[i].len);
+	huge_table[i] = huge_table[--huge_count];
+}
+
+/*
+ * huge_free - Unmap a huge block
+ */
+static void huge_free(void *ptr)
+{
+	int i;
+	pthread_mutex_lock(&huge_lock);
+	if ((i = huge_find(ptr)) < 0)
+		dbg_printf("free(%p): not a block of this heap\n", ptr);
+	else
+		huge_unmap(i);
+	pthread_mutex_unlock(&huge_lock);
+}
+
+/*
+ * huge_realloc - Resize a huge block with mremap, which moves the pages 
+ *      rather than copying them. A block that shrinks below 
+ *      HUGE_THRESHOLD moves back into the current arena.
+ */
+static void *huge_realloc(void *ptr, size_t size)
+{
+	size_t len = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	char *addr = NULL;
+	int i;
+	pthread_mutex_lock(&huge_lock);
+	if ((i = huge_find(ptr)) < 0 || len < size)
+		;
+	else if (size < HUGE_THRESHOLD) {
+		if ((addr = heap_malloc(size)) != NULL) {
+			memcpy(addr, ptr, size);
+			huge_unmap(i);
+		}
+	}
+	else {
+		addr = mremap(huge_table[i].addr, huge_table[i].len, len, 
+			MREMAP_MAYMOVE);
+		if (addr == MAP_FAILED)
+			addr = NULL;
+		else {
+			huge_table[i].addr = addr;
+			huge_table[i].len = len;
+		}
+	}
+	pthread_mutex_unlock(&huge_lock);
+	return addr;
+}
+
+/*
+ * grow_in_place - Try to grow the allocated block ptr to asize bytes 
+ *      without moving it: absorb a free successor, growing the heap first 
+ *      when the block is the last one. Failing that, slide the payload 
+ *      down into a free predecessor with memmove. Returns the block's 
+ *      new address, or NULL if it has to be moved elsewhere.
+ */
+static void *grow_in_place(void *ptr, size_t oldsize, size_t asize)
+{
+	char *bp = ptr, *next = NEXT_BLKP(ptr);
+	size_t size, prev = GET_PREV_ALLOC(HDRP(ptr));
+	size_t nextsize = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+
+	/* the last block takes the shortfall straight from the heap; the new 
+	   space coalesces with a free successor, or starts at next */
+	if (oldsize + nextsize < asize 
+		&& GET_SIZE(HDRP(nextsize ? NEXT_BLKP(next) : next)) == 0) {
+		if (grow_heap(asize - oldsize - nextsize) == NULL)
+			return NULL;
+		nextsize = GET_SIZE(HDRP(next));
+	}
+	if (oldsize + nextsize >= asize) {
+		if (nextsize)
+			removeFromFreeList(next);
+		size = oldsize + nextsize;
+	}
+	else if (!prev 
+		&& GET_SIZE(HDRP(PREV_BLKP(ptr))) + oldsize + nextsize >= asize) {
+		bp = PREV_BLKP(ptr);
+		removeFromFreeList(bp);
+		if (nextsize)
+			removeFromFreeList(next);
+		size = GET_SIZE(HDRP(bp)) + oldsize + nextsize;
+		prev = GET_PREV_ALLOC(HDRP(bp));
+		memmove(bp, ptr, oldsize - WSIZE);
+	}
+	else
+		return NULL;
+	/* split off the tail as place() does */
+	if (size - asize >= 2*DSIZE) {
+		PUT(HDRP(bp), PACK(asize, 1 | prev));
+		next = NEXT_BLKP(bp);
+		PUT(HDRP(next), PACK(size - asize, PREV_ALLOC));
+		PUT(FTRP(next), PACK(size - asize, PREV_ALLOC));
+		CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(next)));
+		addToFreeList(next);
+	}
+	else {
+		PUT(HDRP(bp), PACK(size, 1 | prev));
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	}
+	return bp;
+}
+
+/* 
+ * mm_malloc - Allocate a block with at least size bytes of payload, from 
+ *      the thread's cache when it holds one of the right size and from 
+ *      the thread's arena otherwise
+ */
+void *malloc(size_t size)
+{
+	int tc = tc_index(size);
+	arena_t *a = thread_arena();
+	void *bp;
+	if (tc >= 0)
+		return cache_malloc(a, tc, size);
+	arena_lock(a);
+	remote_drain();
+	bp = heap_malloc(size);
+	arena_unlock();
+	return bp;
+}
+
+/*
+ * cache_malloc - Allocate a block of size bytes from cache bin tc, the 
+ *      CPU's if it has one and the thread's otherwise, refilling the bin 
+ *      from arena a when it is empty
+ */
+inline static void *cache_malloc(arena_t *a, int tc, size_t size)
+{
+	void *bp;
+#ifdef RSEQ
+	if (cpucache_usable()) {
+		if ((bp = cpucache_pop(tc)) != NULL)
+			return bp;
+		return cpucache_refill(a, tc, size);
+	}
+#endif
+	if (tcache.count[tc] != 0) {
+		bp = tcache.head[tc];
+		tcache.head[tc] = *(void **)bp;
+		tcache.count[tc]--;
+		return bp;
+	}
+	return tcache_refill(a, tc, size);
+}
+
+/* 
+ * mm_free - Free a block. A block the CPU cache has a bin for goes there. 
+ *      Otherwise a block of another arena goes on that arena's remote 
+ *      stack, one of the thread's own arena into the thread's cache when 
+ *      it has a bin for the block's size and straight back to the arena 
+ *      otherwise.
+ */
+void free(void *bp)
+{
+	arena_t *a;
+	if (bp == 0)
+		return;
+	thread_arena();
+	if ((a = arena_of(bp)) == NULL) {
+		huge_free(bp);
+		return;
+	}
+	free_block(a, bp, tc_index_of(a, bp));
+}
+
+/*
+ * mm_free_sized - Free a block allocated for size bytes. The size picks 
+ *      the cache bin, so a block that goes to a cache is freed without 
+ *      reading its header.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+	arena_t *a;
+	if (bp == 0)
+		return;
+	thread_arena();
+	if ((a = arena_of(bp)) == NULL) {
+		huge_free(bp);
+		return;
+	}
+#ifdef DEBUG
+	if (IS_SLAB_PTR(a, bp) ? SLAB_OF(bp)->objsize < size 
+		: GET_SIZE(HDRP(bp)) < ALIGN(size))
+		dbg_printf("free_sized(%p, %lu): block is smaller\n", bp, size);
+#endif
+	/* a heap bin serves sizes up to its own, so any block of size bytes 
+	   fits, but a slab bin hands out whole slots: a heap block that small, 
+	   aligned or shrunk by realloc, is binned by its header */
+	if (size <= SLAB_MAX && !IS_SLAB_PTR(a, bp))
+		free_block(a, bp, tc_index_of(a, bp));
+	else
+		free_block(a, bp, tc_index(size));
+}
+
+/*
+ * free_block - The rest of mm_free() for a block of arena a, with tc its 
+ *      cache bin or -1
+ */
+inline static void free_block(arena_t *a, void *bp, int tc)
+{
+#ifdef RSEQ
+	if (cpucache_usable() && tc >= 0) {
+		while (!cpucache_push(tc, bp))
+			cpucache_flush(tc, TC_BATCH);
+		return;
+	}
+#endif
+	if (a != tcache.arena) {
+		remote_free(a, bp);
+		return;
+	}
+	if (tc >= 0) {
+		*(void **)bp = tcache.head[tc];
+		tcache.head[tc] = bp;
+		if (++tcache.count[tc] > TC_LIMIT)
+			tcache_flush(tc, TC_BATCH);
+		return;
+	}
+	arena_lock(a);
+	heap_free(bp);
+	arena_unlock();
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes each into out, under 
+ *      a single acquisition of the thread's arena lock and bypassing the 
+ *      caches. Returns the number of blocks allocated, fewer than n only 
+ *      when memory runs out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+	arena_t *a = thread_arena();
+	size_t got;
+	arena_lock(a);
+	remote_drain();
+	got = heap_malloc_batch(size, n, out);
+	arena_unlock();
+	return got;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, which is sorted by address 
+ *      in the process. The blocks of each arena are freed under one 
+ *      acquisition of its lock, and blocks that lie next to each other 
+ *      are merged before they are freed.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+	arena_t *a;
+	size_t i, j;
+	thread_arena();
+	qsort(ptrs, n, sizeof(void *), ptr_cmp);
+	for (i = 0; i < n; i = j) {
+		j = i + 1;
+		if (ptrs[i] == NULL)
+			continue;
+		if ((a = arena_of(ptrs[i])) == NULL) {
+			huge_free(ptrs[i]);
+			continue;
+		}
+		/* an arena's blocks are contiguous once sorted */
+		while (j < n && IN_ARENA(a, ptrs[j]))
+			j++;
+		arena_lock(a);
+		heap_free_batch(ptrs + i, j - i);
+		arena_unlock();
+	}
+}
+
+/*
+ * mm_realloc - Resize a block in the arena it came from, see heap_realloc. 
+ *      Huge blocks that move back into a heap go to the thread's arena.
+ */
+void *realloc(void *ptr, size_t size)
+{
+	arena_t *a, *owner;
+	void *newptr;
+	if (ptr == NULL)
+		return malloc(size);
+	if (size == 0) {
+		free(ptr);
+		return 0;
+	}
+	a = thread_arena();
+	if ((owner = arena_of(ptr)) != NULL)
+		a = owner;
+	arena_lock(a);
+	newptr = heap_realloc(ptr, size);
+	arena_unlock();
+	return newptr;
+}
+
+/*
+ * tc_index - The cache bin that serves requests of size bytes, or -1 
+ *      if they are not cached
+ */
+inline static int tc_index(size_t size)
+{
+	size_t asize;
+	if (size == 0)
+		return -1;
+	if (size <= SLAB_MAX)
+		return SLAB_CLASS(size);
+	if (size > TC_MAX)
+		return -1;
+	/* the block heap_malloc() would carve for size */
+	asize = (size <= DSIZE) ? 2*DSIZE : ALIGN(size);
+	if (asize < TC_HEAP_MIN || asize > TC_MAX)
+		return -1;
+	return NUM_SLAB_CLASSES + (asize - TC_HEAP_MIN) / DSIZE;
+}
+
+/*
+ * tc_index_of - The cache bin an allocated block of arena a goes back 
+ *      to, or -1. A heap block serves every request whose adjusted size 
+ *      is at most its own, so it is binned by its block size.
+ */
+inline static int tc_index_of(arena_t *a, void *bp)
+{
+	size_t asize;
+	if (IS_SLAB_PTR(a, bp))
+		return SLAB_CLASS(SLAB_OF(bp)->objsize);
+	asize = GET_SIZE(HDRP(bp));
+	if (asize < TC_HEAP_MIN || asize > TC_MAX)
+		return -1;
+	return NUM_SLAB_CLASSES + (asize - TC_HEAP_MIN) / DSIZE;
+}
+
+/*
+ * tcache_reset - Drop a cache that still holds blocks of an old heap, and 
+ *      the thread's binding to an arena of it. A cache bound after the 
+ *      heap it remembers was replaced is on the list of the current one, 
+ *      and leaves it so that arena_bind() does not link it in twice.
+ */
+inline static void tcache_reset(void)
+{
+	tcache_t *t;
+	if (tcache.arena != NULL) {
+		pthread_mutex_lock(&arenas_lock);
+		for (t = tcaches; t != NULL && t != &tcache; t = t->next)
+			;
+		if (t != NULL)
+			tcache_unlink();
+		pthread_mutex_unlock(&arenas_lock);
+	}
+	memset(&tcache, 0, sizeof(tcache));
+	tcache.generation = heap_generation;
+}
+
+static void tcache_init_key(void)
+{
+	pthread_key_create(&tcache_key, tcache_exit);
+}
+
+/*
+ * tcache_refill - Allocate a block for bin tc from arena a and stock the 
+ *      bin with up to TC_BATCH - 1 more
+ */
+static void *tcache_refill(arena_t *a, int tc, size_t size)
+{
+	void *batch[TC_BATCH];
+	int i, n = central_get(a, tc, size, batch, TC_BATCH);
+	for (i = 1; i < n; i++) {
+		*(void **)batch[i] = tcache.head[tc];
+		tcache.head[tc] = batch[i];
+		tcache.count[tc]++;
+	}
+	return n ? batch[0] : NULL;
+}
+
+/*
+ * tcache_flush - Give the n most recently cached blocks of bin tc back 
+ *      to the thread's arena, the only one the cache holds blocks of. The 
+ *      caller holds no lock.
+ */
+static void tcache_flush(int tc, int n)
+{
+	void *batch[TC_BATCH];
+	int m;
+	while (n > 0 && tcache.count[tc] != 0) {
+		for (m = 0; m < n && m < TC_BATCH && tcache.count[tc] != 0; m++) {
+			batch[m] = tcache.head[tc];
+			tcache.head[tc] = *(void **)batch[m];
+			tcache.count[tc]--;
+		}
+		central_put(tcache.arena, tc, batch, m);
+		n -= m;
+	}
+}
+
+/*
+ * central_get - Take up to n blocks for bin tc of arena a: from the bin's 
+ *      transfer cache if it has any, else from the heap. Returns the 
+ *      number of blocks taken.
+ */
+static int central_get(arena_t *a, int tc, size_t size, void **batch, int n)
+{
+	central_t *c = &a->central[tc];
+	int got = 0;
+	pthread_mutex_lock(&c->lock);
+	while (got < n && c->count != 0)
+		batch[got++] = c->slot[--c->count];
+	pthread_mutex_unlock(&c->lock);
+	if (got != 0)
+		return got;
+	arena_lock(a);
+	remote_drain();
+	while (got < n && (batch[got] = heap_malloc(size)) != NULL)
+		got++;
+	arena_unlock();
+	return got;
+}
+
+/*
+ * central_put - Give n blocks of bin tc back to arena a: into the bin's 
+ *      transfer cache while it has room, the rest to the heap
+ */
+static void central_put(arena_t *a, int tc, void **batch, int n)
+{
+	central_t *c = &a->central[tc];
+	pthread_mutex_lock(&c->lock);
+	while (n > 0 && c->count < CENTRAL_MAX)
+		c->slot[c->count++] = batch[--n];
+	pthread_mutex_unlock(&c->lock);
+	if (n == 0)
+		return;
+	arena_lock(a);
+	while (n > 0)
+		heap_free(batch[--n]);
+	arena_unlock();
+}
+
+/*
+ * central_drain - Empty every transfer cache of arena a into its heap
+ */
+static void central_drain(arena_t *a)
+{
+	central_t *c;
+	int tc;
+	for (tc = 0; tc < TC_BINS; tc++) {
+		c = &a->central[tc];
+		pthread_mutex_lock(&c->lock);
+		if (c->count != 0) {
+			arena_lock(a);
+			while (c->count != 0)
+				heap_free(c->slot[--c->count]);
+			arena_unlock();
+		}
+		pthread_mutex_unlock(&c->lock);
+	}
+}
+
+/*
+ * tcache_exit - Flush an exiting thread's cache back to the arenas
+ */
+static void tcache_exit(void *arg)
+{
+	int tc;
+	(void)arg;
+	if (tcache.generation != heap_generation || tcache.arena == NULL)
+		return;
+	for (tc = 0; tc < TC_BINS; tc++)
+		tcache_flush(tc, tcache.count[tc]);
+	pthread_mutex_lock(&arenas_lock);
+	tcache_unlink();
+	pthread_mutex_unlock(&arenas_lock);
+}
+
+/*
+ * tcache_unlink - Take the thread's cache off the list of caches. The 
+ *      caller holds arenas_lock.
+ */
+static void tcache_unlink(void)
+{
+	if (tcache.prev != NULL)
+		tcache.prev->next = tcache.next;
+	else
+		tcaches = tcache.next;
+	if (tcache.next != NULL)
+		tcache.next->prev = tcache.prev;
+	tcache.prev = tcache.next = NULL;
+}
+
+/*
+ * A fork copies the allocator in whatever state its other threads left 
+ * it, locks held and all, into a child where only the forking thread 
+ * runs. So before the fork that thread takes every lock, in the usual 
+ * order, which waits out whatever the others were doing; the parent 
+ * then lets go of them and the child initializes them afresh. The child 
+ * also hands the cached blocks of the threads it did not inherit back 
+ * to their arenas, as their exit would have.
+ */
+static void atfork_init(void)
+{
+	pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+/*
+ * atfork_prepare - Take every lock of the allocator before a fork
+ */
+static void atfork_prepare(void)
+{
+	int i, tc;
+	pthread_mutex_lock(&bg_lock);
+	pthread_mutex_lock(&arenas_lock);
+	for (i = 0; i < arena_count; i++)
+		for (tc = 0; tc < TC_BINS; tc++)
+			pthread_mutex_lock(&arenas[i].central[tc].lock);
+	for (i = 0; i < arena_count; i++)
+		pthread_mutex_lock(&arenas[i].lock);
+	pthread_mutex_lock(&huge_lock);
+}
+
+/*
+ * atfork_parent - Release the locks atfork_prepare took
+ */
+static void atfork_parent(void)
+{
+	int i, tc;
+	pthread_mutex_unlock(&huge_lock);
+	for (i = arena_count - 1; i >= 0; i--)
+		pthread_mutex_unlock(&arenas[i].lock);
+	for (i = arena_count - 1; i >= 0; i--)
+		for (tc = TC_BINS - 1; tc >= 0; tc--)
+			pthread_mutex_unlock(&arenas[i].central[tc].lock);
+	pthread_mutex_unlock(&arenas_lock);
+	pthread_mutex_unlock(&bg_lock);
+}
+
+/*
+ * atfork_child - Initialize every lock of the allocator afresh and free 
+ *      the blocks cached by threads that did not survive the fork
+ */
+static void atfork_child(void)
+{
+	tcache_t *t;
+	void *bp, *next;
+	int i, tc;
+	pthread_mutex_init(&arenas_lock, NULL);
+	pthread_mutex_init(&huge_lock, NULL);
+	/* the maintenance thread stayed behind in the parent */
+	pthread_mutex_init(&bg_lock, NULL);
+	pthread_cond_init(&bg_cond, NULL);
+	bg_running = 0;
+	bg_pressure = 0;
+	for (i = 0; i < arena_count; i++)
+		arena_init_locks(&arenas[i]);
+	for (t = tcaches; t != NULL; t = t->next) {
+		if (t == &tcache || t->generation != heap_generation)
+			continue;
+		/* walk the links rather than trust the count, which a thread 
+		   stopped halfway through a push or pop left behind */
+		arena_lock(t->arena);
+		for (tc = 0; tc < TC_BINS; tc++)
+			for (bp = t->head[tc]; bp != NULL; bp = next) {
+				next = *(void **)bp;
+				heap_free(bp);
+			}
+		arena_unlock();
+	}
+	/* their caches are gone with them */
+	tcaches = NULL;
+	if (tcache.generation == heap_generation && tcache.arena != NULL) {
+		tcache.prev = tcache.next = NULL;
+		tcaches = &tcache;
+	}
+}
+#ifdef RSEQ
+
+/*
+ * rseq_area - The calling thread's rseq area, registered by glibc
+ */
+#define rseq_area() \
+	((struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset))
+
+/*
+ * The rseq critical sections of cpucache_pop and cpucache_push. Both find 
+ * the bin of the current CPU in [rax]+count and [rax]+slot and end with 
+ * the store that commits. The descriptor goes in the __rseq_cs section 
+ * and the abort handler is preceded by the signature the kernel checks. 
+ * The kernel clears rseq_cs when it aborts, so the handler restarts from 
+ * the store that installs it.
+ */
+#define CPUCACHE_CS_BEGIN \
+	".pushsection __rseq_cs, \"aw\"\n\t" \
+	".balign 32\n" \
+	"3:\t.long 0, 0\n\t" \
+	".quad 1f, 2f - 1f, 4f\n\t" \
+	".popsection\n" \
+	"7:\tleaq 3b(%%rip), %%rax\n\t" \
+	"movq %%rax, %c[cs](%[rs])\n" \
+	"1:\tmovl %c[cpu](%[rs]), %%eax\n\t" \
+	"imulq %[stride], %%rax\n\t" \
+	"addq %[base], %%rax\n\t" \
+	"movl (%%rax, %[count]), %%ecx\n\t"
+#define CPUCACHE_CS_END \
+	"jmp 5f\n\t" \
+	".long %c[sig]\n" \
+	"4:\tjmp 7b\n"
+#define CPUCACHE_CS_ARGS(tc) \
+	[rs] "r" (rseq_area()), [base] "r" (cpucaches), \
+	[stride] "r" (sizeof(cpucache_t)), \
+	[count] "r" ((tc) * sizeof(unsigned)), \
+	[slot] "r" (offsetof(cpucache_t, slot) + (tc) * sizeof(cpucaches->slot[0])), \
+	[cs] "i" (offsetof(struct rseq, rseq_cs)), \
+	[cpu] "i" (offsetof(struct rseq, cpu_id)), [sig] "i" (RSEQ_SIG)
+
+/*
+ * cpucache_usable - Can the calling thread use the CPU caches
+ */
+inline static int cpucache_usable(void)
+{
+	return cpucaches != NULL && (int)rseq_area()->cpu_id >= 0;
+}
+
+/*
+ * cpucache_pop - Pop a block off bin tc of the current CPU, or return 
+ *      NULL if the bin is empty
+ */
+inline static void *cpucache_pop(int tc)
+{
+	void *bp;
+	__asm__ __volatile__(
+		CPUCACHE_CS_BEGIN
+		"xorl %k[bp], %k[bp]\n\t"
+		"testl %%ecx, %%ecx\n\t"
+		"jz 2f\n\t"
+		"decl %%ecx\n\t"
+		"leaq (%%rax, %[slot]), %%rdx\n\t"
+		"movq (%%rdx, %%rcx, 8), %[bp]\n\t"
+		"movl %%ecx, (%%rax, %[count])\n"
+		"2:\t"
+		CPUCACHE_CS_END
+		"5:\n"
+		: [bp] "=&r" (bp)
+		: CPUCACHE_CS_ARGS(tc)
+		: "rax", "rcx", "rdx", "memory", "cc");
+	return bp;
+}
+
+/*
+ * cpucache_push - Push bp on bin tc of the current CPU. Returns 0 if the 
+ *      bin is full.
+ */
+inline static int cpucache_push(int tc, void *bp)
+{
+	int ok;
+	__asm__ __volatile__(
+		CPUCACHE_CS_BEGIN
+		"cmpl %[limit], %%ecx\n\t"
+		"jae 6f\n\t"
+		"leaq (%%rax, %[slot]), %%rdx\n\t"
+		"movq %[bp], (%%rdx, %%rcx, 8)\n\t"
+		"incl %%ecx\n\t"
+		"movl %%ecx, (%%rax, %[count])\n"
+		"2:\tmovl $1, %[ok]\n\t"
+		CPUCACHE_CS_END
+		"6:\txorl %[ok], %[ok]\n"
+		"5:\n"
+		: [ok] "=&r" (ok)
+		: CPUCACHE_CS_ARGS(tc), [bp] "r" (bp), [limit] "i" (TC_LIMIT)
+		: "rax", "rcx", "rdx", "memory", "cc");
+	return ok;
+}
+
+/*
+ * cpucache_refill - Allocate a block for bin tc from arena a and stock 
+ *      the current CPU's bin with up to TC_BATCH - 1 more
+ */
+static void *cpucache_refill(arena_t *a, int tc, size_t size)
+{
+	void *batch[TC_BATCH];
+	int i, n = central_get(a, tc, size, batch, TC_BATCH);
+	for (i = 1; i < n; i++)
+		if (!cpucache_push(tc, batch[i]))
+			break;
+	/* the bin filled up under us, hand the rest back */
+	if (i < n)
+		central_put(a, tc, batch + i, n - i);
+	return n ? batch[0] : NULL;
+}
+
+/*
+ * cpucache_flush - Pop up to n blocks off bin tc of the current CPU and 
+ *      give each back to its arena: the thread's own through its transfer 
+ *      cache, any other through its remote stack
+ */
+static void cpucache_flush(int tc, int n)
+{
+	void *batch[TC_LIMIT], *bp;
+	arena_t *a = thread_arena();
+	int m = 0, own = 0;
+	while (m < n && m < TC_LIMIT && (bp = cpucache_pop(tc)) != NULL) {
+		if (arena_of(bp) == a)
+			batch[own++] = bp;
+		else
+			remote_free(arena_of(bp), bp);
+		m++;
+	}
+	if (own != 0)
+		central_put(a, tc, batch, own);
+}
+#endif
+
+/*
+ * This method basically calls malloc and then initializes everything to 0. 
+ * Sizes the caches serve are small and cleared in full; larger blocks come 
+ * from the arena, which knows what is zero already, and are cleared once 
+ * its lock is released.
+ */
+void *calloc (size_t nmemb, size_t size)
+{
+/*evaluates the total number of bytes, failing if it overflows*/
+  size_t bytes, clear;
+  arena_t *a;
+  void *newptr;
+  int tc;
+  if(__builtin_mul_overflow(nmemb, size, &bytes)){
+	errno = ENOMEM;
+	return NULL;
+  }
+  /* not malloc(), which the compiler may turn back into this calloc() */
+  if((tc = tc_index(bytes)) >= 0){
+	newptr = cache_malloc(thread_arena(), tc, bytes);
+	if(newptr != NULL)
+	  memset(newptr, 0, bytes);
+	return newptr;
+  }
+  a = thread_arena();
+  arena_lock(a);
+  remote_drain();
+  newptr = heap_calloc(bytes, &clear);
+  arena_unlock();
+  if(newptr != NULL && clear != 0)
+	zero_block(newptr, clear);
+  return newptr;
+}
+
+/*
+ * heap_calloc - Allocate a block of size bytes from the current arena 
+ *      and store in *clear how many bytes from its start the caller still 
+ *      has to clear. A fresh mapping needs no clearing, nor does a ZEROED 
+ *      block beyond its link words and old footer.
+ */
+static void *heap_calloc(size_t size, size_t *clear)
+{
+	size_t asize;
+	unsigned zeroed;
+	char *bp;
+	*clear = size;
+	if (size == 0 || size <= SLAB_MAX || size >= HUGE_THRESHOLD 
+		|| size > (1UL << 31) - 2*DSIZE) {
+		if ((bp = heap_malloc(size)) != NULL && !IN_ARENA(arena, bp))
+			*clear = 0;
+		return bp;
+	}
+	asize = (size <= DSIZE) ? 2*DSIZE : ALIGN(size);
+	/* fast bin blocks have been used */
+	if (IS_FAST_SIZE(asize) && arena->fastbins[FAST_INDEX(asize)] != 0)
+		return heap_malloc(size);
+	if ((bp = get_free_block(asize, DSIZE)) == NULL)
+		return NULL;
+	zeroed = GET(HDRP(bp)) & ZEROED;
+	place(bp, asize);
+	if (zeroed) {
+		*clear = 0;
+		memset(bp, 0, MIN(size, 4*WSIZE));
+		/* where the footer was if the block was not split */
+		PUT(FTRP(bp), 0);
+	}
+	return bp;
+}
+
+/*
+ * zero_block - Clear n bytes at p, with non-temporal stores from 
+ *      NT_THRESHOLD bytes up
  */
-void free(void *bp)
+inline static void zero_block(void *p, size_t n)
 {
-	if(bp == 0) 
-		return;
-
-	size_t size = GET_SIZE(HDRP(bp));
-
-/*new free block initialized*/
-	PUT(HDRP(bp), PACK(size, 0));
-	PUT(FTRP(bp), PACK(size, 0));
-	PUT(bp, 0);
-	PUT(bp + WSIZE, 0);
-/*coalescing and then adding it to the freelist*/
-	bp = coalesce(bp);
-	addToFreeList(bp);
+	if (n >= NT_THRESHOLD && zero_stream != NULL)
+		zero_stream(p, n);
+	else
+		memset(p, 0, n);
 }
+#ifdef __x86_64__
+
 /*
- *This method adds a given block to the freelist.
- *It takes in the pointer to the first byte of the payload, 
- *i.e. right after the header.
+ * zero_sse2 - Clear n bytes at p with 16-byte non-temporal stores. The 
+ *      unaligned head and the tail are cleared with memset.
  */
-inline static void addToFreeList(char *bp){
-/*Putting the free block at the beginning of the freelist*/
-	PUT(bp, 0); /*set previous pointer to be zero*/
-	PUT(bp + WSIZE, freelist);
-/*connecting the prev pointer of the initial first node 
-  to bp*/ 
-	if(freelist != 0)
-		PUT(GET_ADDR(freelist) , GET_ADDR_INDEX(bp));
-/*setting freelist to bp*/
-	freelist = GET_ADDR_INDEX(bp);
-	return;
+static void zero_sse2(void *p, size_t n)
+{
+	char *c = p, *end = c + n;
+	size_t head = MIN((size_t)(-(size_t)c & 15), n);
+	__m128i z = _mm_setzero_si128();
+	memset(c, 0, head);
+	for (c += head; end - c >= 64; c += 64) {
+		_mm_stream_si128((__m128i *)c, z);
+		_mm_stream_si128((__m128i *)(c + 16), z);
+		_mm_stream_si128((__m128i *)(c + 32), z);
+		_mm_stream_si128((__m128i *)(c + 48), z);
+	}
+	_mm_sfence();
+	memset(c, 0, end - c);
 }
 
 /*
- *This method removes a given block from the freelist.
- *It takes in the pointer to the first byte of the payload, 
- *i.e. right after the header.
+ * zero_avx2 - zero_sse2() with 32-byte stores
  */
-inline static void removeFromFreeList(char *bp){
-/*storing the previous and the next ptr*/
-	char* ptr = bp + WSIZE;
-	unsigned prev = GET(bp);
-	unsigned next = GET(ptr);
-	if(prev != 0 && next != 0){ /*case 1:*/
-		PUT(((char *)GET_ADDR(prev) + WSIZE), next); 	
-		PUT((GET_ADDR(next)), prev);
-	}
-	else if(prev == 0 && next != 0){ /*case 2:*/	
-		freelist = next;
-		PUT(GET_ADDR(freelist) , 0);
-	}	
-	else if(prev != 0 && next == 0){ /*case 3:*/	
-		PUT(((char *)GET_ADDR(prev) + WSIZE), 0);
-	}
-	else if(prev == 0 && next == 0){ /*case 4:*/
-		freelist = 0;
+__attribute__((target("avx2")))
+static void zero_avx2(void *p, size_t n)
+{
+	char *c = p, *end = c + n;
+	size_t head = MIN((size_t)(-(size_t)c & 31), n);
+	__m256i z = _mm256_setzero_si256();
+	memset(c, 0, head);
+	for (c += head; end - c >= 128; c += 128) {
+		_mm256_stream_si256((__m256i *)c, z);
+		_mm256_stream_si256((__m256i *)(c + 32), z);
+		_mm256_stream_si256((__m256i *)(c + 64), z);
+		_mm256_stream_si256((__m256i *)(c + 96), z);
 	}
+	_mm_sfence();
+	memset(c, 0, end - c);
 }
+#endif
+
 /*
- * coalesce - Boundary tag coalescing. Return ptr to coalesced block
+ * mm_posix_memalign - Store in *memptr a block of at least size bytes 
+ *      whose address is a multiple of alignment, a power of two and a 
+ *      multiple of sizeof(void *). Returns 0, EINVAL for a bad alignment 
+ *      or ENOMEM.
  */
-inline static void *coalesce(void *bp) 
+int posix_memalign(void **memptr, size_t alignment, size_t size)
 {
-	size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-	size_t size = GET_SIZE(HDRP(bp));
+	void *bp;
+	if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0
+		|| alignment == 0)
+		return EINVAL;
+	if ((bp = aligned_malloc(alignment, size)) == NULL && size != 0)
+		return ENOMEM;
+	*memptr = bp;
+	return 0;
+}
 
-	if (prev_alloc && next_alloc) {            /* Case 1 */
-/*Nothing to be done here*/
-	}
-/*only the next block is free so add them together.*/
-	else if (prev_alloc && !next_alloc) {      /* Case 2 */
-	/*remove next block from the free list*/
-		removeFromFreeList(NEXT_BLKP(bp)); 
-		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-		PUT(HDRP(bp), PACK(size, 0));
-		PUT(FTRP(bp), PACK(size, 0));
-	}
-/*only the previous block is free so add them together*/
-	else if (!prev_alloc && next_alloc) {      /* Case 3 */
-		bp = PREV_BLKP(bp);
-/*remove prev block from the free list*/
-		removeFromFreeList(bp); 
-		size += GET_SIZE(HDRP(bp));
-		PUT(HDRP(bp), PACK(size, 0));
-		PUT(FTRP(bp), PACK(size, 0));
-	}
-	else{                                     /* Case 4 */
-		size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
-			GET_SIZE(FTRP(NEXT_BLKP(bp)));
-		removeFromFreeList(NEXT_BLKP(bp));
-		bp = PREV_BLKP(bp);
-		removeFromFreeList(bp);
-		PUT(HDRP(bp), PACK(size, 0));
-		PUT(FTRP(bp), PACK(size, 0));
+/*
+ * mm_aligned_alloc - Allocate size bytes at a multiple of alignment, a 
+ *      power of two
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		errno = EINVAL;
+		return NULL;
 	}
-	return bp;
+	return aligned_malloc(alignment, size);
 }
+
 /*
- * mm_realloc - Naive implementation of realloc
+ * mm_memalign - Allocate size bytes at a multiple of alignment, which is 
+ *      rounded up to a power of two
  */
-void *realloc(void *ptr, size_t size)
+void *memalign(size_t alignment, size_t size)
 {
-	size_t oldsize, asize;
-	void *newptr;
-	
-	/* If oldptr is NULL, then this is just malloc. */
-	if(ptr == NULL) {
-		return malloc(size);
-	}
-	
-	/* If size == 0 then this is just free, and we return NULL. */
-	if(size == 0) {
-		free(ptr);
-		return 0;
-	}
-	
-	oldsize = GET_SIZE(HDRP(ptr));
-	asize = ALIGN(size);
-	/*oldsize is larger than or equal to asize need to shrink block*/
-	if(oldsize >= asize){
-		/*if difference to be shrunk is less than 16 bytes,
-			 then can't shrink*/
-		if(oldsize - asize < (2*DSIZE)){
-			return ptr;
-		}
-		/*else we shrink the block*/
-		else{
-			PUT(HDRP(ptr), PACK(asize,1));
-			PUT(FTRP(ptr), PACK(asize,1));
-		/*store back the remaining space in the freelist*/
-			newptr = NEXT_BLKP(ptr);
-			PUT(HDRP(newptr), PACK(oldsize-asize , 0));
-			PUT(FTRP(newptr), PACK(oldsize-asize , 0));
-			PUT(newptr , 0);
-			PUT(newptr + WSIZE, 0);
-			coalesce(newptr);
-			addToFreeList(newptr);
-			dbg_printf( "realloc() -> %p\n\n", ptr);
-			return ptr;
-		}
-	}
-	else if(asize > oldsize){
-		newptr = malloc(asize);
-		/* If realloc() fails the original block is left untouched  */
-		if(!newptr) {
-			return 0;
-		}
-		/* Copy the old data. */
-		memcpy(newptr, ptr, oldsize);
-		/* Free the old block. */
-		free(ptr);
-		return newptr;
-	}
-	return 0;
+	size_t align = DSIZE;
+	while (align < alignment && align < (1UL << 30))
+		align <<= 1;
+	return aligned_malloc(align, size);
 }
+
 /*
- * This method basically calls malloc and then initializes everything to 0.
+ * mm_valloc - Allocate size bytes at a page boundary
  */
-void *calloc (size_t nmemb, size_t size)
+void *valloc(size_t size)
 {
-/*evaluates the total number of bytes and calls malloc*/
-  size_t bytes = nmemb * size;
-  void *newptr;
-  newptr = malloc(bytes);
-  if(newptr != NULL)
-	memset(newptr, 0, bytes);
-  return newptr;
+	return aligned_malloc(mem_pagesize(), size);
+}
+
+/*
+ * aligned_malloc - Allocate size bytes at a multiple of align, a power 
+ *      of two, from the thread's arena. Alignments up to DSIZE take the 
+ *      plain malloc() path, caches included.
+ */
+static void *aligned_malloc(size_t align, size_t size)
+{
+	arena_t *a;
+	void *bp;
+	if (align <= DSIZE)
+		return malloc(size);
+	a = thread_arena();
+	arena_lock(a);
+	remote_drain();
+	bp = malloc_aligned(align, size);
+	arena_unlock();
+	if (bp == NULL && size != 0)
+		errno = ENOMEM;
+	return bp;
 }
 
 /* 
- * mm_malloc - Allocate a block with at least size bytes of payload 
+ * heap_malloc - Allocate a block with at least size bytes of payload 
+ *      from the current arena
  */
-void *malloc(size_t size) 
+static void *heap_malloc(size_t size) 
 {
 	size_t asize;      /* Adjusted block size */
-	size_t extendsize; /* Amount to extend heap if no fit */
 	char *bp;      
 	dbg_printf("malloc( %lu )\n", size);
 	/* Ignore spurious requests */
 	if (size == 0)
 		return NULL;
+	/* Huge requests get a mapping of their own */
+	if (size >= HUGE_THRESHOLD && (bp = huge_alloc(size)) != NULL)
+		return bp;
+	/* Block sizes must fit in a header and in a mem_sbrk() increment */
+	if (size > (1UL << 31) - 2*DSIZE) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	/* Tiny requests live in header-less slab slots */
+	if (size <= SLAB_MAX)
+		return slab_alloc(size);
 	/* Adjust block size to include overhead and alignment reqs. */
 	if (size <= DSIZE)   
 		asize = 2*DSIZE;    
 	else
 		asize = ALIGN(size);
-	/* Search the free list for a fit */
-	if ((bp = find_fit(asize)) != NULL) {  
-		place(bp, asize);
+	/* Small sizes are popped straight off their fast bin */
+	if (IS_FAST_SIZE(asize) && arena->fastbins[FAST_INDEX(asize)] != 0) {
+		bp = GET_ADDR(arena->fastbins[FAST_INDEX(asize)]);
+		arena->fastbins[FAST_INDEX(asize)] = GET(bp);
+		arena->fast_count--;
 		return bp;
 	}
-	/* No fit found. Get more memory and place the block */
-	extendsize = MAX(asize,CHUNKSIZE);     
-	if ((bp = extend_heap(extendsize/WSIZE)) == NULL)  
+	if ((bp = get_free_block(asize, DSIZE)) == NULL)  
 		return NULL;                             
 	place(bp, asize);
 	return bp;
 } 
+
+/*
+ * get_free_block - Return a free block that is still on the free lists 
+ *      and can hold asize bytes at a payload aligned to align bytes, 
+ *      merging the fast bins or growing the heap when nothing fits.
+ */
+inline static void *get_free_block(size_t asize, size_t align)
+{
+	char *bp, *top, *abp;
+	size_t need = asize, have = 0;
+	/* without an exact fit there must be room to pad up to the boundary */
+	if (align > DSIZE)
+		need += align + 2*DSIZE;
+	/* Search the free list for a fit, merging the fast bins if needed */
+	if ((bp = find_fit(need)) == NULL && arena->fast_count != 0) {
+		consolidate_fastbins();
+		bp = find_fit(need);
+	}
+	if (bp != NULL) {
+		/* the heap is holding steady, so the growth step decays */
+		if (++arena->stable == CHUNK_DECAY) {
+			arena->stable = 0;
+			arena->chunk = MAX(arena->chunk / 2, CHUNKSIZE);
+		}
+		return bp;
+	}
+	/* No fit found. Get more memory. The new block starts at the break, 
+	   or at a free last block it merges with, so only grow by what that 
+	   block and the padding really lack */
+	top = (char *)mem_region_hi(arena->region) + 1;
+	if (!GET_PREV_ALLOC(HDRP(top))) {
+		top = PREV_BLKP(top);
+		have = GET_SIZE(HDRP(top));
+	}
+	abp = top;
+	if (align > DSIZE) {
+		abp = (char *)(((size_t)top + align - 1) & ~(align - 1));
+		if (abp != top && abp - top < 2*DSIZE)
+			abp += align;
+	}
+	/* a free last block can be just short of what find_fit asks for, the 
+	   worst-case padding or a bin boundary, and still hold the block */
+	if ((size_t)(abp - top) + asize <= have)
+		return top;
+	return grow_heap((abp - top) + asize - have);
+}
+
+/*
+ * grow_heap - Extend the heap by need bytes, or by the arena's growth 
+ *      step if that is more, and double the step
+ */
+inline static void *grow_heap(size_t need)
+{
+	size_t size = MAX(need, arena->chunk);
+	arena->chunk = MIN(arena->chunk * 2, CHUNK_MAX);
+	arena->stable = 0;
+	return extend_heap(size/WSIZE);
+}
+
+/*
+ * malloc_aligned - Allocate a block of at least size bytes whose payload 
+ *      is a multiple of align, a power of two. A fit with room for the 
+ *      worst-case padding is split at the aligned boundary and the 
+ *      leading fragment goes back on the free list.
+ */
+static void *malloc_aligned(size_t align, size_t size)
+{
+	size_t asize, csize, lead;
+	char *bp, *abp;
+	if (align <= DSIZE)
+		return heap_malloc(size);
+	/* a mapping of its own is page aligned */
+	if (size >= HUGE_THRESHOLD && align <= mem_pagesize() 
+		&& (bp = huge_alloc(size)) != NULL)
+		return bp;
+	/* the block and its padding must fit in a header */
+	if (size == 0 || align >= (1UL << 30) || size > (1UL << 30))
+		return NULL;
+	if (size <= DSIZE)
+		asize = 2*DSIZE;
+	else
+		asize = ALIGN(size);
+	if ((bp = get_free_block(asize, align)) == NULL)
+		return NULL;
+	abp = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+	/* a leading fragment must itself be a valid free block */
+	if (abp != bp && abp - bp < 2*DSIZE)
+		abp += align;
+	lead = abp - bp;
+	if (lead != 0) {
+		removeFromFreeList(bp);
+		csize = GET_SIZE(HDRP(bp));
+		PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+		PUT(FTRP(bp), GET(HDRP(bp)));
+		addToFreeList(bp);
+		PUT(HDRP(abp), PACK(csize - lead, 0));
+		PUT(FTRP(abp), PACK(csize - lead, 0));
+		addToFreeList(abp);
+	}
+	place(abp, asize);
+	return abp;
+}
+
+/*
+ * slab_alloc - Hand out a slot of the slab class for size, starting a new 
+ *      slab when the class has no free slots left.
+ */
+static void *slab_alloc(size_t size)
+{
+	int cls = SLAB_CLASS(size), i;
+	slab_t *slab;
+	size_t page;
+	unsigned slot;
+	if (arena->slab_partial[cls] == 0) {
+		if ((slab = malloc_aligned(SLAB_BYTES, SLAB_PAYLOAD)) == NULL)
+			return NULL;
+		page = SLAB_PAGE(arena, slab);
+		arena->slab_pages[page / 32] |= 1u << (page % 32);
+		slab->objsize = (cls + 1) * DSIZE;
+		slab->first = (sizeof(slab_t) + DSIZE - 1) & ~(DSIZE - 1);
+		slab->nslots = slab->nfree = 
+			(SLAB_PAYLOAD - slab->first) / slab->objsize;
+		memset(slab->freemap, 0, sizeof(slab->freemap));
+		for (slot = 0; slot < slab->nslots; slot++)
+			slab->freemap[slot / 32] |= 1u << (slot % 32);
+		slab->next = slab->prev = 0;
+		arena->slab_partial[cls] = GET_ADDR_INDEX(slab);
+	}
+	slab = (slab_t *)GET_ADDR(arena->slab_partial[cls]);
+	for (i = 0; slab->freemap[i] == 0; i++)
+		;
+	slot = i * 32 + __builtin_ctz(slab->freemap[i]);
+	slab->freemap[i] &= ~(1u << (slot % 32));
+	/* a full slab leaves the partial list until a slot comes back */
+	if (--slab->nfree == 0) {
+		arena->slab_partial[cls] = slab->next;
+		if (slab->next != 0)
+			((slab_t *)GET_ADDR(slab->next))->prev = 0;
+	}
+	return (char *)slab + slab->first + slot * slab->objsize;
+}
+
+/*
+ * slab_free - Return a slab slot. A slab that becomes empty is given back 
+ *      to the heap unless it is the only one its class has free slots in.
+ */
+static void slab_free(void *ptr)
+{
+	slab_t *slab = SLAB_OF(ptr);
+	int cls = SLAB_CLASS(slab->objsize);
+	unsigned slot = ((char *)ptr - (char *)slab - slab->first) / slab->objsize;
+	unsigned off = GET_ADDR_INDEX(slab);
+	size_t page;
+	slab->freemap[slot / 32] |= 1u << (slot % 32);
+	if (slab->nfree++ == 0) {
+		slab->prev = 0;
+		slab->next = arena->slab_partial[cls];
+		if (slab->next != 0)
+			((slab_t *)GET_ADDR(slab->next))->prev = off;
+		arena->slab_partial[cls] = off;
+	}
+	if (slab->nfree < slab->nslots || (slab->prev == 0 && slab->next == 0))
+		return;
+	if (slab->prev != 0)
+		((slab_t *)GET_ADDR(slab->prev))->next = slab->next;
+	else
+		arena->slab_partial[cls] = slab->next;
+	if (slab->next != 0)
+		((slab_t *)GET_ADDR(slab->next))->prev = slab->prev;
+	page = SLAB_PAGE(arena, slab);
+	arena->slab_pages[page / 32] &= ~(1u << (page % 32));
+	heap_free(slab);
+}
+
+/*
+ * slab_release - Give back the empty slab that slab_free() keeps for 
+ *      each class, so that it does not pin the top of the heap. Returns 
+ *      1 if any slab went back.
+ */
+static int slab_release(void)
+{
+	slab_t *slab;
+	size_t page;
+	int cls, released = 0;
+	for (cls = 0; cls <= NUM_SLAB_CLASSES; cls++) {
+		if (arena->slab_partial[cls] == 0)
+			continue;
+		slab = (slab_t *)GET_ADDR(arena->slab_partial[cls]);
+		/* an empty slab is only kept while it is the class's only one */
+		if (slab->nfree < slab->nslots || slab->next != 0)
+			continue;
+		arena->slab_partial[cls] = 0;
+		page = SLAB_PAGE(arena, slab);
+		arena->slab_pages[page / 32] &= ~(1u << (page % 32));
+		heap_free(slab);
+		released = 1;
+	}
+	return released;
+}
+
 /* 
  * place - Place block of asize bytes at start of free block bp 
  *         and split if remainder would be at least minimum block size
@@ -350,42 +2941,141 @@ inline static void place(void *bp, size_t asize)
 {
 	char* nextbp;
 	size_t csize = GET_SIZE(HDRP(bp));   
+	size_t prev = GET_PREV_ALLOC(HDRP(bp));
+	size_t zeroed = GET(HDRP(bp)) & ZEROED; /* passed on to the remainder */
 	removeFromFreeList(bp);
 	if((csize-asize)>= 2*DSIZE)
 	{		
-		PUT(HDRP(bp), PACK(asize, 1));
-		PUT(FTRP(bp), PACK(asize, 1));
+		PUT(HDRP(bp), PACK(asize, 1 | prev));
 		nextbp = NEXT_BLKP(bp); 
-		PUT(HDRP(nextbp), PACK(csize-asize, 0)); 
-		PUT(FTRP(nextbp), PACK(csize-asize, 0));	
+		PUT(HDRP(nextbp), PACK(csize-asize, PREV_ALLOC | zeroed)); 
+		PUT(FTRP(nextbp), PACK(csize-asize, PREV_ALLOC | zeroed));	
 		addToFreeList(nextbp);
 	}
 	else
 	{
-		PUT(HDRP(bp), PACK(csize, 1));
-		PUT(FTRP(bp), PACK(csize, 1));
+		PUT(HDRP(bp), PACK(csize, 1 | prev));
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
 	}
 
 }
 
+#ifdef TLSF
+/* 
+ * find_fit - Find a fit for a block with asize bytes. asize is rounded up 
+ *            to the next bin boundary so that the head of any non-empty 
+ *            bin at or above it fits, and that bin is picked with two 
+ *            find-first-set operations.
+ */
+inline static void *find_fit(size_t asize)
+{
+	size_t rsize = asize;
+	int cls, fl, sl;
+	unsigned map;
+#ifdef TLSF_SCAN
+	char* ptr;
+	unsigned val;
+#endif
+	if(rsize >= (1 << FL_SHIFT))
+		rsize += (1UL << (63 - __builtin_clzl(rsize) - SL_LOG2)) - 1;
+	if(rsize >= (1UL << 32))
+		cls = NUM_CLASSES - 1;
+	else
+		cls = size_class(rsize);
+	fl = cls / SL_COUNT;
+	sl = cls % SL_COUNT;
+/*first look for a bin at or above sl on the same first level*/
+	map = arena->sl_bitmap[fl] & (~0u << sl);
+	if(map == 0){
+	/*otherwise take the smallest bin of the next non-empty first level*/
+		map = (fl + 1 < FL_COUNT) ? arena->fl_bitmap & (~0u << (fl + 1)) : 0;
+		if(map != 0){
+			fl = __builtin_ctz(map);
+			map = arena->sl_bitmap[fl];
+		}
+	}
+	if(map != 0)
+		return GET_ADDR(arena->freelists[fl * SL_COUNT + __builtin_ctz(map)]);
+#ifdef TLSF_SCAN
+/*nothing above the rounded size; before the heap has to grow, 
+  fall back to first fit within asize's own bin*/
+	for(val = arena->freelists[size_class(asize)]; val != 0; val = GET(ptr + WSIZE)){
+		ptr = GET_ADDR(val);
+		if( GET_SIZE(HDRP(ptr)) >= asize )
+			return ptr;
+	}
+#endif
+	return NULL;
+}
+#else
 /* 
  * find_fit - Find a fit for a block with asize bytes 
  */
 inline static void *find_fit(size_t asize)
 {
 	char* ptr;
-	unsigned val=freelist;
-	size_t blk_size;
-/*loops through the freelist and finds the first fit.*/
+	int cls = size_class(asize);
+	unsigned map, budget = good_fit_candidates;
+/*large requests are served best fit from the tree*/
+	if(IS_TREE_SIZE(asize))
+		return tree_best_fit(asize);
+/*blocks in asize's own class may still be too small, so search it first.
+  Any fit found there is smaller than every block of a larger class*/
+	if((ptr = scan_class(cls, asize, &budget)) != NULL)
+		return ptr;
+/*every block of a larger class fits, jump to the first non-empty one*/
+	map = (cls + 1 < NUM_CLASSES) ? arena->classmap & (~0u << (cls + 1)) : 0;
+	if(map == 0)
+		return tree_best_fit(asize);
+	cls = __builtin_ctz(map);
+	if(policy == MM_FIRST_FIT)
+		return GET_ADDR(arena->freelists[cls]);
+	return scan_class(cls, asize, &budget);
+}
+
+/*
+ * scan_class - Search list cls for a block of at least asize bytes.
+ *      MM_FIRST_FIT returns the first fit from the head, MM_NEXT_FIT 
+ *      the first fit from the class rover onwards, wrapping around, 
+ *      MM_BEST_FIT the smallest fit and MM_GOOD_FIT the smallest of 
+ *      the next *budget fits, consuming the budget as it goes.
+ */
+inline static char *scan_class(int cls, size_t asize, unsigned *budget)
+{
+	char *ptr, *best = NULL;
+	size_t blk_size, best_size = 0;
+	unsigned val = arena->freelists[cls], start = 0;
+	if(policy == MM_NEXT_FIT && arena->rovers[cls] != 0)
+		val = start = arena->rovers[cls];
 	while(val != 0 ){
 		ptr = GET_ADDR(val);
 		blk_size = GET_SIZE(HDRP(ptr));
-		if( blk_size >= asize )
-			return ptr;
+		if( blk_size >= asize ){
+			if(policy == MM_FIRST_FIT || policy == MM_NEXT_FIT){
+				arena->rovers[cls] = val;
+				return ptr;
+			}
+			if(best == NULL || blk_size < best_size){
+				best = ptr;
+				best_size = blk_size;
+			}
+			if(blk_size == asize)
+				break;
+			if(policy == MM_GOOD_FIT && --(*budget) == 0)
+				break;
+		}
 		val = GET( ptr + WSIZE);
+	/*next fit wraps around to the head once and stops at the rover*/
+		if(val == 0 && start != 0){
+			val = arena->freelists[cls];
+			start = 0;
+		}
+		if(policy == MM_NEXT_FIT && start == 0 && val == arena->rovers[cls])
+			break;
 	}
-	return NULL;
+	return best;
 }
+#endif
 /*
  * prints a block given the pointer to the payload
  */
@@ -395,8 +3085,6 @@ inline static void printblock(void *bp)
 	void *pred, *succ;
 	hsize = GET_SIZE(HDRP(bp));
 	halloc = GET_ALLOC(HDRP(bp));  
-	fsize = GET_SIZE(FTRP(bp));
-	falloc = GET_ALLOC(FTRP(bp));
 
 	size_t p, s;
 	p = GET( bp );
@@ -408,11 +3096,17 @@ inline static void printblock(void *bp)
 		printf("%p: epilogue block\n", bp);
 		return;
 	}
-	printf("%p -> header = [%lu:%c], footer = [%lu:%c]\n", bp, 
-			hsize, (halloc ? 'a' : 'f'), 
+	if (halloc) {
+		printf("%p -> header = [%lu:a%c]\n", bp, 
+				hsize, (GET_PREV_ALLOC(HDRP(bp)) ? 'p' : ' '));
+		return;
+	}
+	fsize = GET_SIZE(FTRP(bp));
+	falloc = GET_ALLOC(FTRP(bp));
+	printf("%p -> header = [%lu:f%c], footer = [%lu:%c]\n", bp, 
+			hsize, (GET_PREV_ALLOC(HDRP(bp)) ? 'p' : ' '), 
 			fsize, (falloc ? 'a' : 'f'));
-	if(halloc == 0)
-		printf( "\tpred = [%p], succ = [%p]\n", pred, succ );
+	printf( "\tpred = [%p], succ = [%p]\n", pred, succ );
 }
 
 /*
@@ -421,49 +3115,81 @@ inline static void printblock(void *bp)
 inline static void checkblock(void *bp) 
 {
 /*checking for out of bounds memory*/
-	if((size_t)bp > ((size_t)mem_heap_hi())-3)
+	if((size_t)bp > ((size_t)mem_region_hi(arena->region))-3)
 		printf("using memory out of bounds!!\n");
 /*checking for alignment*/
 	if ((size_t)bp % 8)
 		printf("Error: %p is not doubleword aligned\n", bp);
-/*checking if the header matches the footer */
-	if (GET(HDRP(bp)) != GET(FTRP(bp))){
-		printf("Error: header does[%u] not match footer[%u]\n",
-			 GET(HDRP(bp)), GET(FTRP(bp)));
-	}
 	if(GET_ALLOC(HDRP(bp)) == 0){
-		if(GET_ALLOC(HDRP(PREV_BLKP(bp))) == 0
+/*checking if the header matches the footer, only free blocks have one*/
+		if (GET(HDRP(bp)) != GET(FTRP(bp))){
+			printf("Error: header does[%u] not match footer[%u]\n",
+				 GET(HDRP(bp)), GET(FTRP(bp)));
+		}
+		if(GET_PREV_ALLOC(HDRP(bp)) == 0
 			||  GET_ALLOC(HDRP(NEXT_BLKP(bp))) == 0)
 			printf("this block has not been coalesced!!\n");
+/*checking that a zeroed block really is*/
+		if(GET(HDRP(bp)) & ZEROED)
+			for(char *p = (char *)bp + 4*WSIZE; p < FTRP(bp); p++)
+				if(*p != 0){
+					printf("zeroed block %p has a byte set at %p\n", bp, p);
+					break;
+				}
 	}
 }
 /*
- * checkheap - runs through the heap to 
+ * checkheap - runs through the heap of every arena to 
  *	check for various inconsistencies.
  */
 void mm_checkheap(int verbose) 
 {
-	char *bp = heap_listp;
+	int i, n = __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++) {
+		checkCentral(&arenas[i]);
+		arena_lock(&arenas[i]);
+		checkArena(verbose);
+		arena_unlock();
+	}
+	pthread_mutex_lock(&huge_lock);
+	checkHuge();
+	pthread_mutex_unlock(&huge_lock);
+}
+/*
+ * checks the heap of the current arena
+ */
+inline static void checkArena(int verbose)
+{
+	char *bp = arena->heap_listp;
 
 	if (verbose)
-		printf("Heap (%p):\n", heap_listp);
+		printf("Heap (%p):\n", arena->heap_listp);
 /*check if the prologue block is fine*/
-	if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) 
-		|| !GET_ALLOC(HDRP(heap_listp)))
+	if ((GET_SIZE(HDRP(arena->heap_listp)) != DSIZE) 
+		|| !GET_ALLOC(HDRP(arena->heap_listp)))
 		printf("Bad prologue header\n");
-	checkblock(heap_listp);
+	checkblock(arena->heap_listp);
 	int i=0;
-/*check consistency of each block*/
-	for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) { 
+	size_t prev_alloc = PREV_ALLOC;
+/*check consistency of each block and of the prev-allocated bits*/
+	for (bp = arena->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) { 
 		if(verbose)
 			printblock(bp);
 		checkblock(bp);
+		if(GET_PREV_ALLOC(HDRP(bp)) != prev_alloc)
+			printf("prev-allocated bit of %p is wrong\n", bp);
+		prev_alloc = GET_ALLOC(HDRP(bp)) ? PREV_ALLOC : 0;
 		i++;
 	}
+	if(GET_PREV_ALLOC(HDRP(bp)) != prev_alloc)
+		printf("prev-allocated bit of the epilogue is wrong\n");
 /*run the freelist consistency checker*/
 	checkFreeList();
+	checkFastBins();
+	checkSlabs();
+	checkRemote();
 /*checks if the epilogue block is good*/
-	if( bp != mem_heap_lo() + mem_heapsize() )
+	if( bp != (char *)mem_region_hi(arena->region) + 1 )
 		printf( "wrong epilogue pointer\n" );
 	if (verbose)
 		printblock(bp);
@@ -471,43 +3197,184 @@ void mm_checkheap(int verbose)
 		printf("Bad epilogue header\n");
 }
 /*
- *looks for inconsistencies in the freelist
+ *looks for inconsistencies in the segregated freelists
  */
 inline static void checkFreeList(){
 	char* a;
-	if(freelist == 0){
-		printf("empty freelist\n");
-		return;
-	}
-	int i = 1, j=0;
-	a = GET_ADDR(freelist);
-	if(GET(a)!=0)
-		printf("beginning of the list is messed up!\n");
-    while( GET(a + WSIZE) != 0){
-		/*checks if the freelist has an allocated block*/
-	if( GET_ALLOC( HDRP( a ) ) == 1 )
-		printf("Allocated block found in the freelist\n" );
-	if((size_t)GET_ADDR(GET(a)) < (size_t)(mem_heap_lo()) 
-	     || (size_t)GET_ADDR(GET(a)) > (size_t)(mem_heap_hi())
-	     || (size_t)GET_ADDR(GET(a + WSIZE)) < (size_t)(mem_heap_lo()) 
-	     || (size_t)GET_ADDR(GET(a + WSIZE)) > (size_t)(mem_heap_hi()))
-			printf("out of bounds memory in the freelist\n");
-		/*next's prev ptr == this block*/
-		else if(GET(GET_ADDR(GET(a + WSIZE))) != GET_ADDR_INDEX(a)){
-			printblock(a);
-			printf("NEXT ptr/ PREV ptr of next block are wrong!\n");
-		}
-		a = GET_ADDR( GET(a+WSIZE));
-		i++;
+	int cls, i = 0, j = 0;
+	unsigned prev;
+	for(cls = 0; cls < NUM_CLASSES; cls++){
+		if(CLASS_MAPPED(cls) != (arena->freelists[cls] != 0))
+			printf("arena->classmap out of sync for class %d\n", cls);
+		prev = 0;
+		for(unsigned val = arena->freelists[cls]; val != 0; val = GET(a + WSIZE)){
+			a = GET_ADDR(val);
+			if((size_t)a < (size_t)(mem_region_lo(arena->region)) 
+			     || (size_t)a > (size_t)(mem_region_hi(arena->region))){
+				printf("out of bounds memory in the freelist\n");
+				break;
+			}
+			/*checks if the freelist has an allocated block*/
+			if( GET_ALLOC( HDRP( a ) ) == 1 )
+				printf("Allocated block found in the freelist\n" );
+			if(size_class(GET_SIZE(HDRP(a))) != cls
+				|| IS_TREE_SIZE(GET_SIZE(HDRP(a))))
+				printf("block of size %u found in class %d\n",
+					GET_SIZE(HDRP(a)), cls);
+			/*this block's prev ptr == the block we came from*/
+			if(GET(a) != prev){
+				printblock(a);
+				printf("NEXT ptr/ PREV ptr of next block are wrong!\n");
+			}
+			prev = val;
+			i++;
+		}
 	}
-	for (a = heap_listp; GET_SIZE(HDRP(a)) > 0; a = NEXT_BLKP(a)) {
-               	if(GET_ALLOC(HDRP(a)) == 0)
+	if(T_IS_RED(arena->tree_root))
+		printf("red root in the large block tree\n");
+	checkTree(arena->tree_root, 0, &i);
+	for (a = arena->heap_listp; GET_SIZE(HDRP(a)) > 0; a = NEXT_BLKP(a)) {
+		if(GET_ALLOC(HDRP(a)) == 0)
 			j++;
-        }
-     if((i-1) != j){
-	printf("The number of free blocks counted through the freelist\
+	}
+	if(i != j){
+		printf("The number of free blocks counted through the freelist\
 		don't match the number of the free blocks\
 			 counted by traversing the heap\n");
 	}
-
+}
+/*
+ *checks the subtree rooted at offset n of the large block tree for 
+ *ordering, parent links and red-black balance. Adds the number of 
+ *nodes to count and returns the black height.
+ */
+static int checkTree(unsigned n, unsigned parent, int *count){
+	int lh, rh;
+	if(n == 0)
+		return 1;
+	(*count)++;
+	if(GET_ALLOC(HDRP(GET_ADDR(n))) || !IS_TREE_SIZE(T_SIZE(n)))
+		printf("block %p does not belong in the tree\n", GET_ADDR(n));
+	if(T_PARENT(n) != parent)
+		printf("bad parent link in the tree at %p\n", GET_ADDR(n));
+	if((T_LEFT(n) && !tree_less(T_LEFT(n), n)) 
+		|| (T_RIGHT(n) && !tree_less(n, T_RIGHT(n))))
+		printf("tree out of order at %p\n", GET_ADDR(n));
+	if(T_IS_RED(n) && (T_IS_RED(T_LEFT(n)) || T_IS_RED(T_RIGHT(n))))
+		printf("red node with a red child at %p\n", GET_ADDR(n));
+	lh = checkTree(T_LEFT(n), n, count);
+	rh = checkTree(T_RIGHT(n), n, count);
+	if(lh != rh)
+		printf("unbalanced black height at %p\n", GET_ADDR(n));
+	return lh + !T_IS_RED(n);
+}
+/*
+ *looks for inconsistencies in the fast bins
+ */
+inline static void checkFastBins(){
+	char *a;
+	unsigned n = 0;
+	int i;
+	for(i = 0; i < NUM_FAST; i++){
+		for(unsigned val = arena->fastbins[i]; val != 0; val = GET(a)){
+			a = GET_ADDR(val);
+			if((size_t)a < (size_t)(mem_region_lo(arena->region)) 
+			     || (size_t)a > (size_t)(mem_region_hi(arena->region))){
+				printf("out of bounds memory in fast bin %d\n", i);
+				break;
+			}
+			if(GET_ALLOC(HDRP(a)) == 0)
+				printf("free block found in fast bin %d\n", i);
+			if(GET_SIZE(HDRP(a)) != FAST_MIN + (unsigned)i * DSIZE)
+				printf("block of size %u found in fast bin %d\n",
+					GET_SIZE(HDRP(a)), i);
+			n++;
+		}
+	}
+	if(n != arena->fast_count)
+		printf("fast bins hold %u blocks but the count says %u\n",
+			n, arena->fast_count);
+}
+/*
+ *looks for inconsistencies in the partial slab lists
+ */
+inline static void checkSlabs(){
+	slab_t *slab;
+	unsigned prev, n, i;
+	int cls;
+	for(cls = 0; cls < NUM_SLAB_CLASSES; cls++){
+		prev = 0;
+		for(unsigned val = arena->slab_partial[cls]; val != 0; val = slab->next){
+			slab = (slab_t *)GET_ADDR(val);
+			if(!IS_SLAB_PTR(arena, (char *)slab + slab->first))
+				printf("slab %p is not marked in the page map\n", slab);
+			if((size_t)slab % SLAB_BYTES || !GET_ALLOC(HDRP(slab))
+				|| GET_SIZE(HDRP(slab)) < SLAB_BYTES)
+				printf("slab %p is not an aligned allocated page\n", slab);
+			if(slab->objsize != (cls + 1) * DSIZE)
+				printf("slab %p of size %u in class %d\n", 
+					slab, slab->objsize, cls);
+			if(slab->prev != prev)
+				printf("bad prev link in slab %p\n", slab);
+			for(n = 0, i = 0; i < SLAB_BYTES / DSIZE / 32; i++)
+				n += __builtin_popcount(slab->freemap[i]);
+			if(n != slab->nfree || n == 0)
+				printf("slab %p counts %u free slots but has %u\n",
+					slab, slab->nfree, n);
+			prev = val;
+		}
+	}
+}
+/*
+ *looks for inconsistencies in the remote free stack
+ */
+inline static void checkRemote(){
+	void *bp;
+	for(bp = __atomic_load_n(&arena->remote, __ATOMIC_ACQUIRE); bp != NULL;
+		bp = *(void **)bp){
+		if(!IN_ARENA(arena, bp)){
+			printf("remote free of %p in the wrong arena\n", bp);
+			break;
+		}
+		if(!IS_SLAB_PTR(arena, bp) && !GET_ALLOC(HDRP(bp)))
+			printf("free block %p on the remote stack\n", bp);
+	}
+}
+/*
+ *looks for inconsistencies in the transfer caches of arena a
+ */
+inline static void checkCentral(arena_t *a){
+	central_t *c;
+	unsigned i;
+	int tc;
+	for(tc = 0; tc < TC_BINS; tc++){
+		c = &a->central[tc];
+		pthread_mutex_lock(&c->lock);
+		arena_lock(a);
+		if(c->count > CENTRAL_MAX)
+			printf("transfer cache %d holds %u blocks\n", tc, c->count);
+		for(i = 0; i < c->count && i < CENTRAL_MAX; i++){
+			if(!IN_ARENA(a, c->slot[i]))
+				printf("cached block %p in the wrong arena\n", c->slot[i]);
+			else if(!IS_SLAB_PTR(a, c->slot[i]) && !GET_ALLOC(HDRP(c->slot[i])))
+				printf("free block %p in a transfer cache\n", c->slot[i]);
+		}
+		arena_unlock();
+		pthread_mutex_unlock(&c->lock);
+	}
+}
+/*
+ *looks for inconsistencies in the huge block table
+ */
+inline static void checkHuge(){
+	int i;
+	for(i = 0; i < huge_count; i++){
+		if((size_t)huge_table[i].addr % mem_pagesize()
+			|| huge_table[i].len % mem_pagesize() || huge_table[i].len == 0)
+			printf("huge block %p is not page aligned\n", huge_table[i].addr);
+		if(arena_of(huge_table[i].addr) != NULL)
+			printf("huge block %p lies inside the heap\n", huge_table[i].addr);
+		if(huge_find(huge_table[i].addr) != i)
+			printf("huge block %p is in the table twice\n", huge_table[i].addr);
+	}
 }
@@ -1,5 +1,9 @@
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifdef DRIVER
 
 /* declare functions for driver tests */
@@ -7,6 +11,10 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_valloc(size_t size);
 
 #else
 
@@ -15,11 +23,51 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern void *valloc(size_t size);
 
 #endif
 
 extern int mm_init(void);
 
+/* Placement policies for the segregated free lists */
+enum mm_policy {
+	MM_FIRST_FIT,	/* first block that fits */
+	MM_NEXT_FIT,	/* first fit from where the last search stopped */
+	MM_BEST_FIT,	/* smallest block that fits */
+	MM_GOOD_FIT		/* smallest of the first N blocks that fit */
+};
+
+/* Select the placement policy; candidates is N for MM_GOOD_FIT and 0 
+   keeps the current value. Returns 0 on success, -1 if unsupported. */
+extern int mm_set_policy(int policy, unsigned candidates);
+
+/* Return free heap memory to the system, keeping pad free bytes at the 
+   top of the heap. Returns 1 if any memory was released. */
+extern int mm_trim(size_t pad);
+
+/* Start a thread that coalesces and trims in the background every period 
+   milliseconds, taking that work off free(); 0 stops it. Stop it before 
+   calling mm_init. Returns 0 on success, -1 if it could not start. */
+extern int mm_background(unsigned period);
+
+/* Allocate n blocks of size bytes into out in one go. Returns the number 
+   allocated, less than n only when memory runs out. */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+
+/* Free the n blocks in ptrs in one go; ptrs is sorted by address. */
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* Free a block allocated for size bytes, which spares reading its header. 
+   C++ sized operator delete comes here, see mm_new.cc. */
+extern void mm_free_sized(void *ptr, size_t size);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
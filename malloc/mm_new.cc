@@ -0,0 +1,97 @@
+/*
+ * mm_new.cc - The C++ allocation operators on top of the allocator.
+ * Linking this file in makes new and delete use mm.c, and lets sized
+ * delete pass the size on to mm_free_sized() so that freeing a block
+ * does not have to read its header.
+ */
+#include <new>
+#include <cstddef>
+
+#include "mm.h"
+
+#ifdef DRIVER
+#define malloc mm_malloc
+#define free mm_free
+#endif
+
+/*
+ * new_block - Allocate size bytes, calling the new handler until it
+ *      either makes room or gives up
+ */
+static void *new_block(std::size_t size)
+{
+	void *p;
+	if (size == 0)
+		size = 1;
+	while ((p = malloc(size)) == NULL) {
+		std::new_handler handler = std::get_new_handler();
+		if (handler == NULL)
+			throw std::bad_alloc();
+		handler();
+	}
+	return p;
+}
+
+/*
+ * new_block_nothrow - new_block() for the nothrow operators
+ */
+static void *new_block_nothrow(std::size_t size) noexcept
+{
+	try {
+		return new_block(size);
+	}
+	catch (...) {
+		return NULL;
+	}
+}
+
+void *operator new(std::size_t size)
+{
+	return new_block(size);
+}
+
+void *operator new[](std::size_t size)
+{
+	return new_block(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return new_block_nothrow(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return new_block_nothrow(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+	free(ptr);
+}
+
+/* new turned a request for 0 bytes into one for 1 */
+void operator delete(void *ptr, std::size_t size) noexcept
+{
+	mm_free_sized(ptr, size ? size : 1);
+}
+
+void operator delete[](void *ptr, std::size_t size) noexcept
+{
+	mm_free_sized(ptr, size ? size : 1);
+}